@@ -387,6 +387,9 @@ class LivingPipeline: NSObject {
                                           audioBitRate: mode.config.audioBitRate,
                                           audioCodecName: mode.config.audioCodecName)
             livePublisher?.delegate = self
+            livePublisher?.enableAdaptiveBitRate(withMinBitRate: mode.config.recordingBitRate / 4,
+                                                 maxBitRate: mode.config.recordingBitRate,
+                                                 minFrameRate: mode.config.recordingFrameRate / 2)
             livePublisher?.start()
         } else {
             DDLogError("Could not start recording")
@@ -539,4 +542,15 @@ extension LivingPipeline: LivePublisherDelegate {
         }
     }
     
+    func publishQueueCongested(_ congested: Bool, fillPercent: Int) {
+        DDLogWarn("live publish queue congested \(congested) fill percent \(fillPercent)")
+    }
+    
+    func publishTargetBitRateChanged(_ bitRate: Int, frameRate: Int) {
+        DDLogInfo("live publish target bit rate \(bitRate) frame rate \(frameRate)")
+        DispatchQueue.main.async { [weak self] in
+            self?.videoEncoder?.adjust(bitRate: bitRate, fps: frameRate)
+        }
+    }
+    
 }
@@ -0,0 +1,95 @@
+//
+//  live_drop_sync_check.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+/**
+ * 新来的视频帧在入队前被丢掉之后，检查视频时间线压缩的时长和记给音频的欠账是否相同，不在工程里，单独编译运行：
+ *   c++ -O2 -I.. live_drop_sync_check.cpp ../live_packet_pool.cpp ../live_video_packet_queue.cpp ../live_audio_packet_queue.cpp \
+ *       ../live_pcm_ring_buffer.cpp ../live_audio_drift_compensator.cpp ../live_audio_jitter_buffer.cpp ../live_buffer_pool.cpp \
+ *       ../live_video_drop_policy.cpp ../live_discard_controller.cpp ../live_nal_parser.cpp ../live_packet_notifier.cpp \
+ *       ../live_clock.cpp -lpthread -o drop_sync_check && ./drop_sync_check
+ * 非 Apple 平台的头文件不会间接带进 string.h，编译时再加 -include string.h
+ * 音频按采样计数打时间戳，丢掉多少 PCM 音频就提前多少；视频丢掉的时长必须同样从时间线上去掉
+ */
+
+#include "live_packet_pool.h"
+
+#define CHECK_FRAME_INTERVAL_MILLS                                      33
+#define CHECK_FRAME_SIZE                                                64
+#define CHECK_DROPPED_FRAMES                                            20
+
+// 原始时间放在 pts 里，出队后和重排过的 timeMills 比较
+static LiveVideoPacket* obtainFrame(LivePacketPool *pool, int index, int naluHeader) {
+    LiveVideoPacket *videoPacket = pool->obtainVideoPacket(CHECK_FRAME_SIZE);
+    memset(videoPacket->buffer, 0xAA, CHECK_FRAME_SIZE);
+    videoPacket->buffer[0] = 0x00;
+    videoPacket->buffer[1] = 0x00;
+    videoPacket->buffer[2] = 0x00;
+    videoPacket->buffer[3] = 0x01;
+    videoPacket->buffer[4] = naluHeader;
+    videoPacket->timeMills = index * CHECK_FRAME_INTERVAL_MILLS;
+    videoPacket->pts = videoPacket->timeMills;
+    return videoPacket;
+}
+
+int main() {
+    LivePacketPool *pool = new LivePacketPool();
+    // 不按时长和字节丢 GOP，只让环形队列满了之后的入队丢帧生效
+    LiveVideoQueueBudget budget = { 0, 0, VIDEO_PACKET_QUEUE_HIGH_WATERMARK_PERCENT, VIDEO_PACKET_QUEUE_LOW_WATERMARK_PERCENT };
+    pool->setVideoQueueBudget(budget);
+    pool->initRecordingVideoPacketQueue();
+    int index = 0;
+    // 队头是 SPS，队列满了也丢不动队头的 GOP，新来的 P 帧一直丢到下一个 IDR；丢的时候队列里还有包
+    pool->pushRecordingVideoPacketToQueue(obtainFrame(pool, index++, 0x67));
+    pool->pushRecordingVideoPacketToQueue(obtainFrame(pool, index++, 0x65));
+    int droppedFrames = 0;
+    while (droppedFrames < CHECK_DROPPED_FRAMES) {
+        if (pool->pushRecordingVideoPacketToQueue(obtainFrame(pool, index++, 0x41))) {
+            droppedFrames++;
+        }
+    }
+    // 消费者先取走一部分，IDR 进来之后丢帧结束
+    LiveVideoPacket *videoPackets[VIDEO_PACKET_QUEUE_RING_CAPACITY];
+    int64_t timelineShiftMills = -1;
+    bool passed = true;
+    int count = pool->getRecordingVideoPackets(videoPackets, VIDEO_PACKET_QUEUE_RING_CAPACITY / 2, 0);
+    for (int i = 0; i < count; i++) {
+        pool->releaseStagedVideoPacket(videoPackets[i]);
+        delete videoPackets[i];
+    }
+    pool->pushRecordingVideoPacketToQueue(obtainFrame(pool, index++, 0x65));
+    pool->pushRecordingVideoPacketToQueue(obtainFrame(pool, index++, 0x41));
+    LiveDiscardStats stats;
+    pool->getDiscardStats(&stats);
+    while ((count = pool->getRecordingVideoPackets(videoPackets, VIDEO_PACKET_QUEUE_RING_CAPACITY, 0)) > 0) {
+        for (int i = 0; i < count; i++) {
+            LiveVideoPacket *videoPacket = videoPackets[i];
+            int64_t shiftMills = videoPacket->pts - videoPacket->timeMills;
+            // 丢帧点之后的包都应该提前同样的时长，丢帧点之前的包不动
+            if (shiftMills != 0 && shiftMills != stats.videoDroppedMills) {
+                printf("packet at %lld ms retimed to %d ms, video dropped %lld ms\n",
+                       (long long)videoPacket->pts, videoPacket->timeMills, (long long)stats.videoDroppedMills);
+                passed = false;
+            }
+            if (shiftMills != 0) {
+                timelineShiftMills = shiftMills;
+            }
+            pool->releaseStagedVideoPacket(videoPacket);
+            delete videoPacket;
+        }
+    }
+    pool->destroyRecordingVideoPacketQueue();
+    delete pool;
+    if (timelineShiftMills != stats.videoDroppedMills || stats.outstandingDebtMills != stats.videoDroppedMills) {
+        printf("video timeline shifted %lld ms, audio debt %lld ms, video dropped %lld ms\n",
+               (long long)timelineShiftMills, (long long)stats.outstandingDebtMills, (long long)stats.videoDroppedMills);
+        passed = false;
+    }
+    printf("%s: dropped %lld ms of video, later packets shifted by the same amount as the audio debt\n",
+           passed ? "PASS" : "FAIL", (long long)stats.videoDroppedMills);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+//
+//  live_nal_parser_bench.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+/**
+ * LiveNALParser::findZeroPair 的吞吐量测试，不在工程里，单独编译运行：
+ *   c++ -O2 -I.. live_nal_parser_bench.cpp ../live_nal_parser.cpp ../live_clock.cpp -lpthread -o nal_bench && ./nal_bench
+ * 默认是当前平台的向量路径（arm64 上 NEON，x86 上 SSE2），加 -DLIVE_NAL_PARSER_NO_SIMD 重新编译就是 8 字节的标量路径
+ * 每次都会和逐字节扫描的参考实现对比结果，同时给出参考实现的吞吐量
+ */
+
+#include "live_nal_parser.h"
+
+#if defined(LIVE_NAL_PARSER_NO_SIMD)
+#define BENCH_PATH_NAME                                                 "scalar (8 bytes)"
+#elif defined(__aarch64__)
+#define BENCH_PATH_NAME                                                 "NEON"
+#elif defined(__SSE2__)
+#define BENCH_PATH_NAME                                                 "SSE2"
+#else
+#define BENCH_PATH_NAME                                                 "scalar (8 bytes)"
+#endif
+
+#define BENCH_BUFFER_SIZE                                               (300 * 1024) // 一个 1080p IDR 帧的大小
+#define BENCH_SLICE_SIZE                                                (30 * 1024)
+#define BENCH_CHECK_BUFFER_SIZE                                         4096
+#define BENCH_MIN_BYTES                                                 (1024LL * 1024 * 1024)
+
+// 原来的逐字节扫描，作为正确性和速度的参考
+static int referenceFindZeroPair(const uint8_t *data, int size, int offset) {
+    for (int i = offset; i + 1 < size; i++) {
+        if (data[i] == 0x00 && data[i + 1] == 0x00) {
+            return i;
+        }
+    }
+    return size;
+}
+
+typedef int (*find_zero_pair_func)(const uint8_t *, int, int);
+
+// 从头扫到尾，返回找到的 00 00 个数
+static int scanAll(find_zero_pair_func find, const uint8_t *data, int size) {
+    int count = 0;
+    int position = find(data, size, 0);
+    while (position < size) {
+        count++;
+        position = find(data, size, position + 1);
+    }
+    return count;
+}
+
+static double measureGBps(find_zero_pair_func find, const uint8_t *data, int size, int *count) {
+    int iterations = (int)(BENCH_MIN_BYTES / size) + 1;
+    int64_t startNanos = platform_4_live::getMonotonicTimeNanos();
+    for (int i = 0; i < iterations; i++) {
+        *count = scanAll(find, data, size);
+    }
+    int64_t costNanos = platform_4_live::getMonotonicTimeNanos() - startNanos;
+    return (double)size * iterations / costNanos;
+}
+
+// 只有 00 / 01 / 03 的数据里 00 00 非常密，每个起点都和参考实现对比，覆盖向量路径的边界和尾部
+static bool checkDense() {
+    static const uint8_t values[] = { 0x00, 0x01, 0x03 };
+    uint8_t *data = new uint8_t[BENCH_CHECK_BUFFER_SIZE];
+    for (int i = 0; i < BENCH_CHECK_BUFFER_SIZE; i++) {
+        data[i] = values[rand() % 3];
+    }
+    bool passed = true;
+    for (int size = BENCH_CHECK_BUFFER_SIZE - 40; size <= BENCH_CHECK_BUFFER_SIZE && passed; size++) {
+        for (int offset = 0; offset <= size; offset++) {
+            if (LiveNALParser::findZeroPair(data, size, offset) != referenceFindZeroPair(data, size, offset)) {
+                printf("mismatch at size %d offset %d\n", size, offset);
+                passed = false;
+                break;
+            }
+        }
+    }
+    delete[] data;
+    return passed;
+}
+
+int main() {
+    srand(20261017);
+    if (!checkDense()) {
+        return 1;
+    }
+    // 压缩后的 slice 数据接近随机，每个 slice 前面放一个 4 字节起始码
+    uint8_t *data = new uint8_t[BENCH_BUFFER_SIZE];
+    for (int i = 0; i < BENCH_BUFFER_SIZE; i++) {
+        data[i] = (uint8_t)(rand() & 0xFF);
+    }
+    for (int i = 0; i + 4 <= BENCH_BUFFER_SIZE; i += BENCH_SLICE_SIZE) {
+        data[i] = 0x00;
+        data[i + 1] = 0x00;
+        data[i + 2] = 0x00;
+        data[i + 3] = 0x01;
+    }
+    int parserCount = 0;
+    int referenceCount = 0;
+    double parserGBps = measureGBps(LiveNALParser::findZeroPair, data, BENCH_BUFFER_SIZE, &parserCount);
+    double referenceGBps = measureGBps(referenceFindZeroPair, data, BENCH_BUFFER_SIZE, &referenceCount);
+    delete[] data;
+    if (parserCount != referenceCount) {
+        printf("mismatch: %d zero pairs, reference %d\n", parserCount, referenceCount);
+        return 1;
+    }
+    printf("findZeroPair %-16s %6.2f GB/s\n", BENCH_PATH_NAME, parserGBps);
+    printf("byte-wise reference           %6.2f GB/s\n", referenceGBps);
+    printf("%d zero pairs in %d bytes\n", parserCount, BENCH_BUFFER_SIZE);
+    return 0;
+}
@@ -18,17 +18,35 @@ NS_ASSUME_NONNULL_BEGIN
 - (void)onConnectFailed;
 - (void)publishTimeOut;
 
+@optional
+// 待发送的视频队列超过高水位 congested 为 YES，回落到低水位以下为 NO，可以据此调整编码码率
+- (void)publishQueueCongested:(BOOL)congested fillPercent:(NSInteger)fillPercent;
+// 打开自适应码率后，根据主输出的发送积压和吞吐给出新的目标码率和帧率，在发送线程回调
+- (void)publishTargetBitRateChanged:(NSInteger)bitRate frameRate:(NSInteger)frameRate;
+
 @end
 
+typedef NS_ENUM(NSInteger, LivePublisherVideoCodec) {
+    LivePublisherVideoCodecH264 = 0,
+    LivePublisherVideoCodecHEVC = 1,
+};
+
 @interface LivePublisher : NSObject
 
 @property (nonatomic, weak) id<LivePublisherDelegate> delegate;
 @property (nonatomic, assign) double startConnectTimeMills;
+// 编码格式，需要在 start 之前设置；HEVC 推 RTMP 需要 FFmpeg 支持 enhanced-FLV，本地 MP4 没有限制
+@property (nonatomic, assign) LivePublisherVideoCodec videoCodec;
 
 - (instancetype)initWithRTMPURL:(NSString *)rtmpURL
      videoWidth:(NSInteger)videoWidth videoHeight:(NSInteger)videoHeight videoFrameRate:(NSInteger)videoFrameRate videoBitRate:(NSInteger)videoBitRate
                 audioSampleRate:(NSInteger)audioSampleRate audioChannels:(NSInteger)audioChannels audioBitRate:(NSInteger)audioBitRate audioCodecName:(NSString *)audioCodecName;
+// 除了 rtmpURL 之外再发一路输出（备用 RTMP 地址或者本地 .flv / .mp4 文件路径），需要在 start 之前调用
+- (void)addOutputURL:(NSString *)outputURL;
+// 打开自适应码率，码率在 [minBitRate, maxBitRate] 之间调整，码率降到下限还拥塞时帧率最低降到 minFrameRate，需要在 start 之前调用
+- (void)enableAdaptiveBitRateWithMinBitRate:(NSInteger)minBitRate maxBitRate:(NSInteger)maxBitRate minFrameRate:(NSInteger)minFrameRate;
 - (void)gotSpsPps:(NSData*)sps pps:(NSData*)pps timestramp:(Float64)miliseconds;
+- (void)gotVps:(NSData*)vps sps:(NSData*)sps pps:(NSData*)pps timestramp:(Float64)miliseconds;
 - (void)gotEncodedData:(NSData*)data isKeyFrame:(BOOL)isKeyFrame timestramp:(Float64)miliseconds;
 - (void)receiveAudioBuffer:(AudioBuffer)buffer sampleRate:(int)sampleRate startRecordTimeMills:(Float64)startRecordTimeMills;
 - (void)start;
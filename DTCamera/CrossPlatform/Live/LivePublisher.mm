@@ -10,7 +10,22 @@
 #import "live_packet_pool.h"
 #import "live_video_packet_queue.h"
 #import "video_consumer_thread.h"
+#import "live_fanout_publisher.h"
 #import "live_audio_encoder_adapter.h"
+#import "live_bitrate_controller.h"
+#import <pthread.h>
+
+static void *kConsumerQueueKey = &kConsumerQueueKey;
+
+#define AVCC_LENGTH_SIZE                                                4
+
+/* 写一个 4 字节大端长度前缀的 NAL，返回写完之后的位置 */
+static byte* write_avcc_nalu(byte *buffer, NSData *nalu) {
+    uint32_t naluLength = CFSwapInt32HostToBig((uint32_t)nalu.length);
+    memcpy(buffer, &naluLength, AVCC_LENGTH_SIZE);
+    memcpy(buffer + AVCC_LENGTH_SIZE, (unsigned char*)[nalu bytes], nalu.length);
+    return buffer + AVCC_LENGTH_SIZE + nalu.length;
+}
 
 static int on_publish_timeout_callback(void *context) {
     NSLog(@"PublishTimeoutCallback...\n");
@@ -19,6 +34,20 @@ static int on_publish_timeout_callback(void *context) {
     return 1;
 }
 
+static void on_video_queue_watermark_callback(int level, int fillPercent, void *context) {
+    LivePublisher *publisher = (__bridge LivePublisher*)context;
+    if ([publisher.delegate respondsToSelector:@selector(publishQueueCongested:fillPercent:)]) {
+        [publisher.delegate publishQueueCongested:(level == VIDEO_QUEUE_WATERMARK_HIGH) fillPercent:fillPercent];
+    }
+}
+
+static void on_bitrate_changed_callback(int bitRate, int frameRate, void *context) {
+    LivePublisher *publisher = (__bridge LivePublisher*)context;
+    if ([publisher.delegate respondsToSelector:@selector(publishTargetBitRateChanged:frameRate:)]) {
+        [publisher.delegate publishTargetBitRateChanged:bitRate frameRate:frameRate];
+    }
+}
+
 @interface LivePublisher ()
 
 @property (nonatomic, copy) NSString *rtmpURL;
@@ -30,15 +59,18 @@ static int on_publish_timeout_callback(void *context) {
 @property (nonatomic, assign) NSInteger audioChannels;
 @property (nonatomic, assign) NSInteger audioBitRate;
 @property (nonatomic, copy) NSString *audioCodecName;
+@property (nonatomic, strong) NSMutableArray<NSString *> *outputURLs;
 
-@property (nonatomic, assign) int totalSampleCount;
 
 @end
 
 @implementation LivePublisher
 {
-    VideoConsumerThread *_consumer;
-    LiveAudioEncoderAdapter *_audioEncoder;
+    LivePacketPool *_packetPool; // 采集到的 PCM 和编码数据的缓冲区池，各路输出的队列在 _fanout 里
+    LiveFanoutPublisher *_fanout; // 采集线程读，start / stop 写，都要持有 _fanoutLock
+    pthread_mutex_t _fanoutLock;
+    LiveAudioEncoderAdapter *_audioEncoder; // 只在 _consumerQueue 上创建和销毁
+    LiveBitrateController *_bitrateController;
     dispatch_queue_t _consumerQueue;
 }
 
@@ -57,120 +89,167 @@ static int on_publish_timeout_callback(void *context) {
         self.audioBitRate = audioBitRate;
         self.audioCodecName = audioCodecName;
         _consumerQueue = dispatch_queue_create("com.danthought.LivePublisher.consumerQueue", NULL);
+        dispatch_queue_set_specific(_consumerQueue, kConsumerQueueKey, kConsumerQueueKey, NULL);
+        pthread_mutex_init(&_fanoutLock, NULL);
+        self.outputURLs = [NSMutableArray array];
+        _packetPool = new LivePacketPool();
     }
     return self;
 }
 
+- (void)dealloc {
+    [self stop];
+    delete _packetPool;
+    _packetPool = NULL;
+    pthread_mutex_destroy(&_fanoutLock);
+    if (NULL != _bitrateController) {
+        delete _bitrateController;
+        _bitrateController = NULL;
+    }
+}
+
+- (void)addOutputURL:(NSString *)outputURL {
+    [self.outputURLs addObject:outputURL];
+}
+
+- (void)enableAdaptiveBitRateWithMinBitRate:(NSInteger)minBitRate maxBitRate:(NSInteger)maxBitRate minFrameRate:(NSInteger)minFrameRate {
+    if (NULL != _bitrateController) {
+        delete _bitrateController;
+    }
+    _bitrateController = new LiveBitrateController((int)self.videoBitRate, (int)minBitRate, (int)maxBitRate,
+                                                   (int)self.videoFrameRate, (int)minFrameRate);
+    _bitrateController->registerBitrateChangedCallback(on_bitrate_changed_callback, (__bridge void*)self);
+}
+
 - (void)gotSpsPps:(NSData*)sps pps:(NSData*)pps timestramp:(Float64)miliseconds {
-    const char bytesHeader[] = "\x00\x00\x00\x01";
-    size_t headerLength = 4;
-    
-    LiveVideoPacket *videoPacket = new LiveVideoPacket();
+    // 参数集和帧数据一样用 AVCC 格式，发布者从里面取出 SPS/PPS 生成 avcC
+    size_t length = 2 * AVCC_LENGTH_SIZE + sps.length + pps.length;
+    LiveVideoPacket *videoPacket = _packetPool->obtainVideoPacket(int(length));
+    byte *buffer = write_avcc_nalu(videoPacket->buffer, sps);
+    write_avcc_nalu(buffer, pps);
+    videoPacket->timeMills = 0;
     
-    size_t length = 2 * headerLength + sps.length + pps.length;
-    videoPacket->buffer = new unsigned char[length];
-    videoPacket->size = int(length);
-    memcpy(videoPacket->buffer, bytesHeader, headerLength);
-    memcpy(videoPacket->buffer + headerLength, (unsigned char*)[sps bytes], sps.length);
-    memcpy(videoPacket->buffer + headerLength + sps.length, bytesHeader, headerLength);
-    memcpy(videoPacket->buffer + headerLength * 2 + sps.length, (unsigned char*)[pps bytes], pps.length);
+    [self pushVideoPacket:videoPacket];
+}
+
+- (void)gotVps:(NSData*)vps sps:(NSData*)sps pps:(NSData*)pps timestramp:(Float64)miliseconds {
+    size_t length = 3 * AVCC_LENGTH_SIZE + vps.length + sps.length + pps.length;
+    LiveVideoPacket *videoPacket = _packetPool->obtainVideoPacket(int(length));
+    byte *buffer = write_avcc_nalu(videoPacket->buffer, vps);
+    buffer = write_avcc_nalu(buffer, sps);
+    write_avcc_nalu(buffer, pps);
     videoPacket->timeMills = 0;
     
-    LivePacketPool::GetInstance()->pushRecordingVideoPacketToQueue(videoPacket);
+    [self pushVideoPacket:videoPacket];
 }
 
 - (void)gotEncodedData:(NSData*)data isKeyFrame:(BOOL)isKeyFrame timestramp:(Float64)miliseconds {
-    const char bytesHeader[] = "\x00\x00\x00\x01";
-    size_t headerLength = 4;
-
-    LiveVideoPacket *videoPacket = new LiveVideoPacket();
-    
-    videoPacket->buffer = new unsigned char[headerLength + data.length];
-    videoPacket->size = int(headerLength + data.length);
-    memcpy(videoPacket->buffer, bytesHeader, headerLength);
-    memcpy(videoPacket->buffer + headerLength, (unsigned char*)[data bytes], data.length);
+    // 直接写成 4 字节长度前缀的 AVCC 格式，发送时不用再改数据，多路输出可以共享同一份
+    LiveVideoPacket *videoPacket = _packetPool->obtainVideoPacket(int(AVCC_LENGTH_SIZE + data.length));
+    write_avcc_nalu(videoPacket->buffer, data);
     videoPacket->timeMills = miliseconds;
     
-    LivePacketPool::GetInstance()->pushRecordingVideoPacketToQueue(videoPacket);
+    [self pushVideoPacket:videoPacket];
 }
 
 - (void)receiveAudioBuffer:(AudioBuffer)buffer sampleRate:(int)sampleRate startRecordTimeMills:(Float64)startRecordTimeMills {
-    double maxDiffTimeMills = 25;
-    double minDiffTimeMills = 10;
     double audioSamplesTimeMills = CFAbsoluteTimeGetCurrent() * 1000 - startRecordTimeMills;
-    int audioSampleRate = sampleRate;
-    int audioChannels = 2;
-    double dataAccumulateTimeMills = self.totalSampleCount * 1000 / audioSampleRate / audioChannels;
-    if (dataAccumulateTimeMills <= audioSamplesTimeMills - maxDiffTimeMills) {
-        double correctTimeMills = audioSamplesTimeMills - dataAccumulateTimeMills - minDiffTimeMills;
-        int correctBufferSize = (int)(correctTimeMills / 1000.0 * audioSampleRate * audioChannels);
-        LiveAudioPacket *audioPacket = new LiveAudioPacket();
-        audioPacket->buffer = new short[correctBufferSize];
-        memset(audioPacket->buffer, 0, correctBufferSize * sizeof(short));
-        audioPacket->size = correctBufferSize;
-        LivePacketPool::GetInstance()->pushAudioPacketToQueue(audioPacket);
-        self.totalSampleCount += correctBufferSize;
-        NSLog(@"Correct Time Mills is %lf\n", correctTimeMills);
-        NSLog(@"audioSamplesTimeMills is %lf, dataAccumulateTimeMills is %lf\n", audioSamplesTimeMills, dataAccumulateTimeMills);
-    }
     int sampleCount = buffer.mDataByteSize / 2;
-    self.totalSampleCount += sampleCount;
-    short *packetBuffer = new short[sampleCount];
-    memcpy(packetBuffer, buffer.mData, buffer.mDataByteSize);
-    LiveAudioPacket *audioPacket = new LiveAudioPacket();
-    audioPacket->buffer = packetBuffer;
-    audioPacket->size = sampleCount;
-    LivePacketPool::GetInstance()->pushAudioPacketToQueue(audioPacket);
+    // 漂移修正在 C++ 层做，修正之后写进 PCM 环形缓冲区
+    _packetPool->pushCapturedAudioSamples((const short *)buffer.mData, sampleCount, audioSamplesTimeMills);
+}
+
+- (void)pushVideoPacket:(LiveVideoPacket *)videoPacket {
+    // 推的过程中持有锁，stop 拿到锁把 _fanout 置空之后就不会再有采集线程用它
+    pthread_mutex_lock(&_fanoutLock);
+    if (NULL != _fanout) {
+        _fanout->pushVideoPacket(videoPacket);
+    } else {
+        delete videoPacket;
+    }
+    pthread_mutex_unlock(&_fanoutLock);
 }
 
 - (void)start {
-    if (NULL == _consumer) {
-        _consumer = new VideoConsumerThread();
+    pthread_mutex_lock(&_fanoutLock);
+    if (NULL != _fanout) {
+        pthread_mutex_unlock(&_fanoutLock);
+        return;
     }
+    int videoCodec = self.videoCodec == LivePublisherVideoCodecHEVC ? LIVE_VIDEO_CODEC_HEVC : LIVE_VIDEO_CODEC_H264;
+    _packetPool->setVideoCodec(videoCodec);
+    LiveFanoutPublisher *fanout = new LiveFanoutPublisher();
+    fanout->setVideoCodec(videoCodec);
+    fanout->addDestination([self.rtmpURL UTF8String]);
+    for (NSString *outputURL in self.outputURLs) {
+        fanout->addDestination([outputURL UTF8String]);
+    }
+    if (NULL != _bitrateController) {
+        _bitrateController->reset();
+        fanout->setBitrateController(_bitrateController);
+    }
+    _fanout = fanout;
+    pthread_mutex_unlock(&_fanoutLock);
+    // 连接在 _consumerQueue 上做，stop 也在这个串行队列上释放 fanout，不会在连接过程中被删掉
     __weak __typeof(self) weakSelf = self;
     dispatch_async(_consumerQueue, ^{
         __strong __typeof(weakSelf) strongSelf = weakSelf;
+        if (nil == strongSelf) {
+            return;
+        }
         strongSelf.startConnectTimeMills = [[NSDate date] timeIntervalSince1970] * 1000;
-        LivePacketPool::GetInstance()->initRecordingVideoPacketQueue();
-        LivePacketPool::GetInstance()->initAudioPacketQueue((int)strongSelf.audioSampleRate);
-        LiveAudioPacketPool::GetInstance()->initAudioPacketQueue();
-        int consumerInitCode = strongSelf->_consumer->init([strongSelf nsstring2char:strongSelf.rtmpURL],
-                                                           (int)strongSelf.videoWidth,
-                                                           (int)strongSelf.videoHeight,
-                                                           (int)strongSelf.videoFrameRate,
-                                                           (int)strongSelf.videoBitRate,
-                                                           (int)strongSelf.audioSampleRate,
-                                                           (int)strongSelf.audioChannels,
-                                                           (int)strongSelf.audioBitRate,
-                                                           [strongSelf nsstring2char:strongSelf.audioCodecName]);
-        if (consumerInitCode >= 0) {
-            strongSelf->_consumer->registerPublishTimeoutCallback(on_publish_timeout_callback, (__bridge void*)self);
-            strongSelf->_consumer->startAsync();
-            NSLog(@"cosumer open video output success...\n");
-            [strongSelf startAudioEncoding];
+        strongSelf->_packetPool->initAudioPacketQueue((int)strongSelf.audioSampleRate);
+        // 码率跟着主输出的拥塞情况调整
+        fanout->getPacketPool(0)->registerVideoQueueWatermarkCallback(on_video_queue_watermark_callback, (__bridge void*)strongSelf);
+        fanout->registerPublishTimeoutCallback(on_publish_timeout_callback, (__bridge void*)strongSelf);
+        int connectedCount = fanout->start((int)strongSelf.videoWidth,
+                                           (int)strongSelf.videoHeight,
+                                           (int)strongSelf.videoFrameRate,
+                                           (int)strongSelf.videoBitRate,
+                                           (int)strongSelf.audioSampleRate,
+                                           (int)strongSelf.audioChannels,
+                                           (int)strongSelf.audioBitRate,
+                                           [strongSelf.audioCodecName UTF8String]);
+        if (connectedCount >= 0) {
+            NSLog(@"fanout open %d of %d outputs success...\n", connectedCount, fanout->getDestinationCount());
+            [strongSelf startAudioEncodingWithFanout:fanout];
             [strongSelf.delegate onConnectSuccess];
         } else {
-            NSLog(@"cosumer open video output failed...\n");
-            LivePacketPool::GetInstance()->destroyRecordingVideoPacketQueue();
-            LivePacketPool::GetInstance()->destroyAudioPacketQueue();
-            LiveAudioPacketPool::GetInstance()->destroyAudioPacketQueue();
+            NSLog(@"fanout open primary output failed...\n");
+            strongSelf->_packetPool->destroyAudioPacketQueue();
             [strongSelf.delegate onConnectFailed];
         }
     });
 }
 
 - (void)stop {
-    [self stopAudioEncoding];
-    if (_consumer) {
-        _consumer->stop();
-        delete _consumer;
-        _consumer = NULL;
+    pthread_mutex_lock(&_fanoutLock);
+    LiveFanoutPublisher *fanout = _fanout;
+    _fanout = NULL;
+    pthread_mutex_unlock(&_fanoutLock);
+    if (NULL == fanout) {
+        return;
+    }
+    // 先打断还在进行的连接，排在 _consumerQueue 上的连接任务会很快返回
+    fanout->stop();
+    // 同步执行，不需要也不能在 dealloc 里持有 self
+    __unsafe_unretained __typeof(self) unsafeSelf = self;
+    dispatch_block_t releaseBlock = ^{
+        [unsafeSelf stopAudioEncoding];
+        delete fanout;
+    };
+    // dealloc 可能发生在 _consumerQueue 上连接任务的末尾，这时直接执行，避免同步派发到自己所在的队列
+    if (dispatch_get_specific(kConsumerQueueKey) == kConsumerQueueKey) {
+        releaseBlock();
+    } else {
+        dispatch_sync(_consumerQueue, releaseBlock);
     }
 }
 
-- (void)startAudioEncoding {
+- (void)startAudioEncodingWithFanout:(LiveFanoutPublisher *)fanout {
     _audioEncoder = new LiveAudioEncoderAdapter();
-    _audioEncoder->init(LivePacketPool::GetInstance(),
+    _audioEncoder->init(_packetPool,
+                        fanout->getAudioPacketPool(),
                         (int)self.audioSampleRate,
                         (int)self.audioChannels,
                         (int)self.audioBitRate,
@@ -179,6 +258,17 @@ static int on_publish_timeout_callback(void *context) {
 
 - (void)stopAudioEncoding {
     if (NULL != _audioEncoder) {
+        // 编码器销毁时会一起销毁漂移修正和抖动缓冲，先把统计打出来
+        LiveAudioDriftStats driftStats;
+        _packetPool->getAudioDriftStats(&driftStats);
+        NSLog(@"audio drift %.1lf ms, resampled %lld frames, filled %lld gaps %lld frames, overflow %lld samples\n", driftStats.smoothedDriftMills,
+              (long long)driftStats.resampledFrames, (long long)driftStats.gapFillCount, (long long)driftStats.gapFillFrames,
+              (long long)driftStats.overflowSamples);
+        LiveAudioJitterStats jitterStats;
+        _packetPool->getAudioJitterStats(&jitterStats);
+        NSLog(@"audio jitter depth %d/%d ms, underrun %lld times %lld frames, overrun %lld times, trim %lld times, dropped %lld frames\n",
+              jitterStats.depthMills, jitterStats.targetDepthMills, (long long)jitterStats.underrunCount, (long long)jitterStats.concealedFrames,
+              (long long)jitterStats.overrunCount, (long long)jitterStats.trimCount, (long long)jitterStats.droppedFrames);
         _audioEncoder->destroy();
         delete _audioEncoder;
         _audioEncoder = NULL;
@@ -0,0 +1,131 @@
+//
+//  live_audio_drift_compensator.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_audio_drift_compensator.h"
+
+LiveAudioDriftCompensator::LiveAudioDriftCompensator(int sampleRate, int channels) {
+    this->sampleRate = sampleRate;
+    this->channels = channels;
+    outputFrames = 0;
+    smoothedDriftMills = 0;
+    hasEstimate = false;
+    mPosition = 1.0;
+    mLastFrame = new short[channels];
+    memset(mLastFrame, 0, channels * sizeof(short));
+    mBuffer = NULL;
+    mCapacity = 0;
+    statDriftMicros.store(0);
+    statSmoothedDriftMicros.store(0);
+    statCorrectionPpm.store(0);
+    statResampledFrames.store(0);
+    statGapFillCount.store(0);
+    statGapFillFrames.store(0);
+}
+
+LiveAudioDriftCompensator::~LiveAudioDriftCompensator() {
+    delete[] mLastFrame;
+    if (NULL != mBuffer) {
+        delete[] mBuffer;
+    }
+}
+
+void LiveAudioDriftCompensator::ensureCapacity(int sampleSize) {
+    if (sampleSize <= mCapacity) {
+        return;
+    }
+    // 采集每次回调的大小基本固定，只在第一次和变大时分配
+    if (NULL != mBuffer) {
+        delete[] mBuffer;
+    }
+    mCapacity = sampleSize;
+    mBuffer = new short[mCapacity];
+}
+
+int LiveAudioDriftCompensator::process(const short *samples, int sampleSize, double captureTimeMills, LiveAudioDriftOutput *output) {
+    int frameCount = sampleSize / channels;
+    double frameMills = 1000.0 / sampleRate;
+    output->gapSampleSize = 0;
+    output->gapTimeMills = -1;
+    output->samples = samples;
+    output->sampleSize = sampleSize;
+    output->timeMills = outputFrames * frameMills;
+    if (frameCount <= 0) {
+        return 0;
+    }
+    // 回调到达时这一段已经采完，起始时间要减去它自己的时长
+    double driftMills = captureTimeMills - frameCount * frameMills - outputFrames * frameMills;
+    if (driftMills > AUDIO_DRIFT_GAP_FILL_MILLS) {
+        // 采集中断过，平滑修正追不上，补静音把时间线接上
+        int gapFrames = (int)(driftMills / frameMills);
+        output->gapSampleSize = gapFrames * channels;
+        output->gapTimeMills = outputFrames * frameMills;
+        outputFrames += gapFrames;
+        driftMills -= gapFrames * frameMills;
+        statGapFillCount.fetch_add(1);
+        statGapFillFrames.fetch_add(gapFrames);
+        smoothedDriftMills = driftMills;
+    } else if (!hasEstimate) {
+        smoothedDriftMills = driftMills;
+    } else {
+        smoothedDriftMills += (driftMills - smoothedDriftMills) * AUDIO_DRIFT_SMOOTHING_FACTOR;
+    }
+    hasEstimate = true;
+    // 漂移在 AUDIO_DRIFT_CORRECTION_WINDOW_MILLS 之内修正完，修正量有上限，听不出音调变化
+    int correctionPpm = 0;
+    if (fabs(smoothedDriftMills) > AUDIO_DRIFT_DEADBAND_MILLS) {
+        double ppm = smoothedDriftMills * 1000000.0 / AUDIO_DRIFT_CORRECTION_WINDOW_MILLS;
+        correctionPpm = (int)MAX(MIN(ppm, (double)AUDIO_DRIFT_MAX_CORRECTION_PPM), (double)-AUDIO_DRIFT_MAX_CORRECTION_PPM);
+    }
+    statDriftMicros.store((int64_t)(driftMills * 1000));
+    statSmoothedDriftMicros.store((int64_t)(smoothedDriftMills * 1000));
+    statCorrectionPpm.store(correctionPpm);
+    output->timeMills = outputFrames * frameMills;
+    if (0 == correctionPpm && 1.0 == mPosition) {
+        // 不需要修正并且相位对齐时原样输出
+        memcpy(mLastFrame, samples + (frameCount - 1) * channels, channels * sizeof(short));
+        outputFrames += frameCount;
+        return sampleSize;
+    }
+    double step = 1000000.0 / (1000000.0 + correctionPpm);
+    int resampledFrames = resample(samples, frameCount, step);
+    outputFrames += resampledFrames;
+    statResampledFrames.fetch_add(resampledFrames - frameCount);
+    output->samples = mBuffer;
+    output->sampleSize = resampledFrames * channels;
+    return output->sampleSize;
+}
+
+int LiveAudioDriftCompensator::resample(const short *samples, int frameCount, double step) {
+    ensureCapacity(((int)(frameCount / step) + 2) * channels);
+    int resampledFrames = 0;
+    // 输入看成 [mLastFrame, samples[0], ..., samples[frameCount - 1]]，在相邻两帧之间线性插值
+    while (mPosition < frameCount) {
+        int index = (int)mPosition;
+        double fraction = mPosition - index;
+        const short *first = 0 == index ? mLastFrame : samples + (index - 1) * channels;
+        const short *second = samples + index * channels;
+        short *out = mBuffer + resampledFrames * channels;
+        for (int c = 0; c < channels; c++) {
+            out[c] = (short)lrint(first[c] + (second[c] - first[c]) * fraction);
+        }
+        resampledFrames++;
+        mPosition += step;
+    }
+    mPosition -= frameCount;
+    memcpy(mLastFrame, samples + (frameCount - 1) * channels, channels * sizeof(short));
+    return resampledFrames;
+}
+
+void LiveAudioDriftCompensator::getStats(LiveAudioDriftStats *stats) {
+    stats->driftMills = statDriftMicros.load() / 1000.0;
+    stats->smoothedDriftMills = statSmoothedDriftMicros.load() / 1000.0;
+    stats->correctionPpm = statCorrectionPpm.load();
+    stats->resampledFrames = statResampledFrames.load();
+    stats->gapFillCount = statGapFillCount.load();
+    stats->gapFillFrames = statGapFillFrames.load();
+}
@@ -0,0 +1,80 @@
+//
+//  live_audio_drift_compensator.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_audio_drift_compensator_h
+#define live_audio_drift_compensator_h
+
+#include "platform_4_live_common.h"
+#include <atomic>
+
+#define AUDIO_DRIFT_SMOOTHING_FACTOR                                         0.05
+#define AUDIO_DRIFT_DEADBAND_MILLS                                           5
+#define AUDIO_DRIFT_CORRECTION_WINDOW_MILLS                                  10000
+#define AUDIO_DRIFT_MAX_CORRECTION_PPM                                       5000
+#define AUDIO_DRIFT_GAP_FILL_MILLS                                           200
+
+typedef struct LiveAudioDriftStats {
+    double driftMills;           // 这一段的起始时间减去已经产出的采样时长，> 0 表示音频落后于时钟
+    double smoothedDriftMills;
+    int correctionPpm;           // 当前的重采样修正量，> 0 表示拉长
+    int64_t resampledFrames;     // 重采样累计多出来的帧数，< 0 表示累计去掉的
+    int64_t gapFillCount;        // 采集中断补静音的次数
+    int64_t gapFillFrames;
+    int64_t overflowSamples;     // 修正之后写 PCM 环形缓冲区时放不下丢掉的采样数，由 LivePacketPool 填
+} LiveAudioDriftStats;
+
+typedef struct LiveAudioDriftOutput {
+    int gapSampleSize;           // 采集中断时要先补的静音采样数
+    double gapTimeMills;
+    const short *samples;        // 修正之后的采样，下一次 process 之前有效
+    int sampleSize;
+    double timeMills;
+} LiveAudioDriftOutput;
+
+/**
+ * 音频采样时钟和系统时钟之间的漂移修正
+ * 用已经产出的采样数算出的时长和采集时间比较，平滑之后换算成一个很小的重采样比例，逐渐拉长或者压缩音频，不插入静音
+ * 只有采集真的中断（落后超过 AUDIO_DRIFT_GAP_FILL_MILLS）时才补一段静音，把时间线接上
+ * process 只在采集线程调用，统计可以在任意线程读
+ */
+class LiveAudioDriftCompensator {
+public:
+    LiveAudioDriftCompensator(int sampleRate, int channels);
+    ~LiveAudioDriftCompensator();
+
+    /* captureTimeMills 是这一段采样到达时距离开始录制的时间，和视频时间戳同一个起点 */
+    int process(const short *samples, int sampleSize, double captureTimeMills, LiveAudioDriftOutput *output);
+
+    void getStats(LiveAudioDriftStats *stats);
+
+private:
+    int resample(const short *samples, int frameCount, double step);
+    void ensureCapacity(int sampleSize);
+
+    int sampleRate;
+    int channels;
+    int64_t outputFrames;
+
+    double smoothedDriftMills;
+    bool hasEstimate;
+
+    // 分数重采样的状态：mPosition 是下一个输出帧在输入上的位置，0 是上一段的最后一帧，1 是这一段的第一帧
+    double mPosition;
+    short *mLastFrame;
+    short *mBuffer;
+    int mCapacity;
+
+    std::atomic<int64_t> statDriftMicros;
+    std::atomic<int64_t> statSmoothedDriftMicros;
+    std::atomic<int> statCorrectionPpm;
+    std::atomic<int64_t> statResampledFrames;
+    std::atomic<int64_t> statGapFillCount;
+    std::atomic<int64_t> statGapFillFrames;
+};
+
+#endif /* live_audio_drift_compensator_h */
@@ -4,28 +4,38 @@
 
 LiveAudioEncoder::LiveAudioEncoder() {
     encode_frame = NULL;
+    encodedPacket = NULL;
     avCodecContext = NULL;
-    audio_next_pts = 0.0;
+    packetPool = NULL;
+    audio_next_pts = 0;
+    isFlushing = false;
+    hasPendingPackets = false;
 }
 
 LiveAudioEncoder::~LiveAudioEncoder() {
 }
 
 int LiveAudioEncoder::init(int bitRate, int channels, int sampleRate, const char * codec_name,
-        int (*fill_pcm_frame_callback)(int16_t *, int, int, double*, void *context), void* context) {
+        int (*fill_pcm_frame_callback)(int16_t *, int, int, double*, void *context), void* context, LiveAudioPacketPool *packetPool) {
     this->publishBitRate = bitRate;
     this->audioChannels = channels;
     this->audioSampleRate = sampleRate;
     this->fillPCMFrameCallback = fill_pcm_frame_callback;
     this->fillPCMFrameContext = context;
+    this->packetPool = packetPool;
     av_register_all();
     this->alloc_audio_stream(codec_name);
     this->alloc_avframe();
     return 1;
 }
 
-int LiveAudioEncoder::encode(LiveAudioPacket **audioPacket) {
-//    LOGI("begin encode packet..................");
+int LiveAudioEncoder::encode(LiveAudioPacket **audioPackets, int maxCount) {
+#ifdef LIVE_FFMPEG_HAS_SEND_RECEIVE
+    // 上一次没取完的包先取走，编码器不会在输出满着的时候再收新帧
+    if (hasPendingPackets) {
+        return receivePackets(audioPackets, maxCount);
+    }
+#endif
      /** 1、调用注册的回调方法来填充音频的PCM数据 **/
     double presentationTimeMills = -1;
     int actualFillSampleSize = fillPCMFrameCallback((int16_t *) audio_samples_data[0], audio_nb_samples, audioChannels, &presentationTimeMills, fillPCMFrameContext);
@@ -39,40 +49,104 @@ int LiveAudioEncoder::encode(LiveAudioPacket **audioPacket) {
     }
     int actualFillFrameNum = actualFillSampleSize / audioChannels;
     int audioSamplesSize = actualFillFrameNum * audioChannels * sizeof(short);
-    /** 2、将PCM数据按照编码器的格式编码到一个AVPacket中 **/
-    AVRational time_base = {1, audioSampleRate};
-    int ret;
-    AVPacket pkt = { 0 };
-    int got_packet;
-    av_init_packet(&pkt);
-    pkt.duration = (int) AV_NOPTS_VALUE;
-    pkt.pts = pkt.dts = 0;
+    /** 2、把PCM数据送进编码器，再把编码器这时能给出的包全部取出来 **/
     encode_frame->nb_samples = actualFillFrameNum;
     avcodec_fill_audio_frame(encode_frame, avCodecContext->channels, avCodecContext->sample_fmt, audio_samples_data[0], audioSamplesSize, 0);
     encode_frame->pts = audio_next_pts;
     audio_next_pts += encode_frame->nb_samples;
-//    int64_t calcuPTS = presentationTimeMills / 1000 / av_q2d(time_base) / audioChannels;
-//    LOGI("encode_frame pts is %llu, calcuPTS is %llu", encode_frame->pts, calcuPTS);
-    ret = avcodec_encode_audio2(avCodecContext, &pkt, encode_frame, &got_packet);
-    if (ret < 0 || !got_packet) {
+#ifdef LIVE_FFMPEG_HAS_SEND_RECEIVE
+    int ret = avcodec_send_frame(avCodecContext, encode_frame);
+    if (ret < 0) {
+        LOGI("Error sending audio frame: %s\n", av_err2str(ret));
+        return ret;
+    }
+    return receivePackets(audioPackets, maxCount);
+#else
+    return encodeFrame(encode_frame, audioPackets);
+#endif
+}
+
+int LiveAudioEncoder::flush(LiveAudioPacket **audioPackets, int maxCount) {
+#ifdef LIVE_FFMPEG_HAS_SEND_RECEIVE
+    if (!isFlushing) {
+        // 送入空帧进入 draining，编码器把延迟压着的尾包吐出来
+        isFlushing = true;
+        int ret = avcodec_send_frame(avCodecContext, NULL);
+        if (ret < 0 && AVERROR_EOF != ret) {
+            LOGI("Error flushing audio encoder: %s\n", av_err2str(ret));
+            return ret;
+        }
+    }
+    return receivePackets(audioPackets, maxCount);
+#else
+    // 没有延迟的编码器不会压着包；有延迟的每次送一个空帧取一个尾包，取不出来说明取完了
+    if (isFlushing || !(avCodecContext->codec->capabilities & CODEC_CAP_DELAY)) {
+        return 0;
+    }
+    int count = 0;
+    while (count < maxCount) {
+        int ret = encodeFrame(NULL, audioPackets + count);
+        if (ret <= 0) {
+            isFlushing = true;
+            return count > 0 ? count : ret;
+        }
+        count += ret;
+    }
+    return count;
+#endif
+}
+
+LiveAudioPacket* LiveAudioEncoder::obtainAudioPacket() {
+    // 编码后的数据放进缓冲区池借出的 buffer，时间戳用编码器给出的，已经扣掉了编码器延迟
+    AVRational time_base = {1, audioSampleRate};
+    LiveAudioPacket *audioPacket = packetPool->obtainAudioPacket(encodedPacket->size);
+    memcpy(audioPacket->data, encodedPacket->data, encodedPacket->size);
+    int64_t duration = encodedPacket->duration > 0 ? encodedPacket->duration : avCodecContext->frame_size;
+    audioPacket->setTimestamp(av_rescale_q(encodedPacket->pts, avCodecContext->time_base, time_base),
+                              (int)av_rescale_q(duration, avCodecContext->time_base, time_base), audioSampleRate);
+//    LOGI("size and position is {%lf, %d}", audioPacket->position, audioPacket->size);
+    return audioPacket;
+}
+
+#ifndef LIVE_FFMPEG_HAS_SEND_RECEIVE
+int LiveAudioEncoder::encodeFrame(AVFrame *frame, LiveAudioPacket **audioPacket) {
+    int got_packet = 0;
+    int ret = avcodec_encode_audio2(avCodecContext, encodedPacket, frame, &got_packet);
+    if (ret < 0) {
         LOGI("Error encoding audio frame: %s\n", av_err2str(ret));
-        av_free_packet(&pkt);
         return ret;
     }
-    if (got_packet) {
-        pkt.pts = av_rescale_q(encode_frame->pts, avCodecContext->time_base, time_base);
-        //转换为我们的LiveAudioPacket
-        (*audioPacket) = new LiveAudioPacket();
-        (*audioPacket)->data = new byte[pkt.size];
-        memcpy((*audioPacket)->data, pkt.data, pkt.size);
-        (*audioPacket)->size = pkt.size;
-        (*audioPacket)->position = (float)(pkt.pts * av_q2d(time_base) * 1000.0f);
-//        LOGI("size and position is {%f, %d}", (*audioPacket)->position, (*audioPacket)->size);
-    }
-    av_free_packet(&pkt);
-    return ret;
-//    LOGI("leave encode packet...");
+    // 没有包不是错误：编码器还在攒延迟需要的帧，或者已经 flush 完了
+    if (!got_packet) {
+        return 0;
+    }
+    (*audioPacket) = obtainAudioPacket();
+    av_free_packet(encodedPacket);
+    return 1;
+}
+#endif
+
+#ifdef LIVE_FFMPEG_HAS_SEND_RECEIVE
+int LiveAudioEncoder::receivePackets(LiveAudioPacket **audioPackets, int maxCount) {
+    int count = 0;
+    hasPendingPackets = false;
+    while (count < maxCount) {
+        int ret = avcodec_receive_packet(avCodecContext, encodedPacket);
+        // 没有包不是错误：编码器还在攒延迟需要的帧，或者已经 flush 完了
+        if (AVERROR(EAGAIN) == ret || AVERROR_EOF == ret) {
+            return count;
+        }
+        if (ret < 0) {
+            LOGI("Error encoding audio frame: %s\n", av_err2str(ret));
+            return count > 0 ? count : ret;
+        }
+        audioPackets[count++] = obtainAudioPacket();
+        av_packet_unref(encodedPacket);
+    }
+    hasPendingPackets = true;
+    return count;
 }
+#endif
 
 void LiveAudioEncoder::destroy() {
     LOGI("start destroy!!!");
@@ -80,7 +154,20 @@ void LiveAudioEncoder::destroy() {
         av_free(audio_samples_data[0]);
     }
     if (NULL != encode_frame) {
+#ifdef LIVE_FFMPEG_HAS_FRAME_ALLOC
+        av_frame_free(&encode_frame);
+#else
         av_free(encode_frame);
+        encode_frame = NULL;
+#endif
+    }
+    if (NULL != encodedPacket) {
+#ifdef LIVE_FFMPEG_HAS_SEND_RECEIVE
+        av_packet_free(&encodedPacket);
+#else
+        av_free_packet(encodedPacket);
+        av_freep(&encodedPacket);
+#endif
     }
     if (NULL != avCodecContext) {
         avcodec_close(avCodecContext);
@@ -122,8 +209,21 @@ int LiveAudioEncoder::alloc_audio_stream(const char * codec_name) {
 
 int LiveAudioEncoder::alloc_avframe() {
     int ret = 0;
+#ifdef LIVE_FFMPEG_HAS_FRAME_ALLOC
+    encode_frame = av_frame_alloc();
+#else
     encode_frame = avcodec_alloc_frame();
-    if (!encode_frame) {
+#endif
+#ifdef LIVE_FFMPEG_HAS_SEND_RECEIVE
+    encodedPacket = av_packet_alloc();
+#else
+    // 老版本没有 av_packet_alloc，自己分配一个复用
+    encodedPacket = (AVPacket *)av_mallocz(sizeof(AVPacket));
+    if (NULL != encodedPacket) {
+        av_init_packet(encodedPacket);
+    }
+#endif
+    if (!encode_frame || !encodedPacket) {
         LOGI("Could not allocate audio frame\n");
         return -1;
     }
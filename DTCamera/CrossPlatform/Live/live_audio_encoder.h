@@ -12,6 +12,7 @@
 #include <stdlib.h>
 #include <time.h>
 #include "live_audio_packet_queue.h"
+#include "live_audio_packet_pool.h"
 
 #ifndef UINT64_C
 #define UINT64_C(value)__CONCAT(value,ULL)
@@ -28,17 +29,24 @@ extern "C" {
     #include "libavutil/imgutils.h"
     #include "libavutil/mathematics.h"
 };
+#include "platform_4_live_ffmpeg.h"
 
 #ifndef PUBLISH_BITE_RATE
 #define PUBLISH_BITE_RATE 64000
 #endif
 
+#define AUDIO_ENCODER_MAX_PACKETS_PER_WAKEUP 8
+
 class LiveAudioEncoder {
 private:
     /** 音频流数据输出 **/
     AVCodecContext *                            avCodecContext;
     AVFrame *                                encode_frame;
+    AVPacket *                                  encodedPacket;
     int64_t                                     audio_next_pts;
+    bool                                        isFlushing;
+    bool                                        hasPendingPackets;
+    LiveAudioPacketPool *                       packetPool;
 
     uint8_t **                                audio_samples_data;
     int                                       audio_nb_samples;
@@ -51,6 +59,14 @@ private:
     //初始化的时候，要进行的工作
     int alloc_avframe();
     int alloc_audio_stream(const char * codec_name);
+#ifdef LIVE_FFMPEG_HAS_SEND_RECEIVE
+    int receivePackets(LiveAudioPacket **audioPackets, int maxCount);
+#else
+    /* 老接口一次送一帧最多出一个包，frame 为 NULL 时取编码器延迟压着的尾包，返回取出的包数 */
+    int encodeFrame(AVFrame *frame, LiveAudioPacket **audioPacket);
+#endif
+    /* 把 encodedPacket 里的数据和时间戳转成 LiveAudioPacket */
+    LiveAudioPacket* obtainAudioPacket();
 
     /** 声明填充一帧PCM音频的方法 **/
     typedef int (*fill_pcm_frame_callback)(int16_t *, int, int, double*, void *context);
@@ -63,8 +79,11 @@ public:
     virtual ~LiveAudioEncoder();
 
     int init(int bitRate, int channels, int sampleRate, const char * codec_name,
-            int (*fill_pcm_frame_callback)(int16_t *, int, int, double*, void *context), void* context);
-    int encode(LiveAudioPacket** audioPacket);
+            int (*fill_pcm_frame_callback)(int16_t *, int, int, double*, void *context), void* context, LiveAudioPacketPool *packetPool);
+    /* 填充一帧 PCM 送进编码器，取出编码器这时能给出的所有包（最多 maxCount 个），返回取出的包数，< 0 表示填充失败或者编码出错 */
+    int encode(LiveAudioPacket **audioPackets, int maxCount);
+    /* 停止时取出编码器延迟压着的尾包，返回取出的包数，取完返回 0 */
+    int flush(LiveAudioPacket **audioPackets, int maxCount);
     void destroy();
 };
 #endif //AUDIO_ENCODER_H
@@ -22,12 +22,9 @@ static int fill_pcm_frame_callback(int16_t *samples, int frame_size, int nb_chan
     return adapter->getAudioFrame(samples, frame_size, nb_channels, presentationTimeMills);
 }
 
-void LiveAudioEncoderAdapter::init(LivePacketPool *pcmPacketPool, int audioSampleRate, int audioChannels, int audioBitRate, const char *audio_codec_name) {
-    this->channelRatio = 1.0f;
-    this->packetBuffer = NULL;
-    this->packetBufferSize = 0;
-    this->packetBufferCursor = 0;
+void LiveAudioEncoderAdapter::init(LivePacketPool *pcmPacketPool, LiveAudioPacketPool *aacPacketPool, int audioSampleRate, int audioChannels, int audioBitRate, const char *audio_codec_name) {
     this->pcmPacketPool = pcmPacketPool;
+    this->aacPacketPool = aacPacketPool;
     this->audioSampleRate = audioSampleRate;
     this->audioChannels = audioChannels;
     this->audioBitRate = audioBitRate;
@@ -36,7 +33,6 @@ void LiveAudioEncoderAdapter::init(LivePacketPool *pcmPacketPool, int audioSampl
     memset(audioCodecName, 0, audioCodecNameLength + 1);
     memcpy(audioCodecName, audio_codec_name, audioCodecNameLength);
     this->isEncoding = true;
-    this->aacPacketPool = LiveAudioPacketPool::GetInstance();
     pthread_create(&audioEncoderThread, NULL, startEncodeThread, this);
 }
 
@@ -49,12 +45,19 @@ void* LiveAudioEncoderAdapter::startEncodeThread(void *ptr) {
 
 void LiveAudioEncoderAdapter::startEncode() {
     audioEncoder = new LiveAudioEncoder();
-    audioEncoder->init(audioBitRate, audioChannels, audioSampleRate, audioCodecName, fill_pcm_frame_callback, this);
+    audioEncoder->init(audioBitRate, audioChannels, audioSampleRate, audioCodecName, fill_pcm_frame_callback, this, aacPacketPool);
+    LiveAudioPacket *audioPackets[AUDIO_ENCODER_MAX_PACKETS_PER_WAKEUP];
     while (isEncoding) {
-        LiveAudioPacket *audioPacket = NULL;
-        int ret = audioEncoder->encode(&audioPacket);
-        if (ret >= 0 && NULL != audioPacket) {
-            aacPacketPool->pushAudioPacketToQueue(audioPacket);
+        int count = audioEncoder->encode(audioPackets, AUDIO_ENCODER_MAX_PACKETS_PER_WAKEUP);
+        for (int i = 0; i < count; i++) {
+            aacPacketPool->pushAudioPacketToQueue(audioPackets[i]);
+        }
+    }
+    // 停止时把编码器延迟压着的尾包也送出去
+    int count = 0;
+    while ((count = audioEncoder->flush(audioPackets, AUDIO_ENCODER_MAX_PACKETS_PER_WAKEUP)) > 0) {
+        for (int i = 0; i < count; i++) {
+            aacPacketPool->pushAudioPacketToQueue(audioPackets[i]);
         }
     }
 }
@@ -73,47 +76,19 @@ void LiveAudioEncoderAdapter::destroy() {
         delete[] audioCodecName;
         audioCodecName = NULL;
     }
-    if (NULL != packetBuffer) {
-        delete packetBuffer;
-        packetBuffer = NULL;
-    }
 }
 
 int LiveAudioEncoderAdapter::getAudioFrame(int16_t * samples, int frame_size, int nb_channels,
         double* presentationTimeMills) {
-    int byteSize = frame_size * nb_channels * 2;
-    int samplesInShortCursor = 0;
-    while (true) {
-        if (packetBufferSize == 0) {
-            int ret = this->getAudioPacket();
-            if (ret < 0) {
-                return ret;
-            }
-        }
-        int copyToSamplesInShortSize = (byteSize - samplesInShortCursor * 2) / 2;
-        if (packetBufferCursor + copyToSamplesInShortSize <= packetBufferSize) {
-            this->cpyToSamples(samples, samplesInShortCursor, copyToSamplesInShortSize, presentationTimeMills);
-            packetBufferCursor += copyToSamplesInShortSize;
-            samplesInShortCursor = 0;
-            break;
-        } else {
-            int subPacketBufferSize = packetBufferSize - packetBufferCursor;
-            this->cpyToSamples(samples, samplesInShortCursor, subPacketBufferSize, presentationTimeMills);
-            samplesInShortCursor += subPacketBufferSize;
-            packetBufferSize = 0;
-            continue;
-        }
-    }
-    return frame_size * nb_channels;
-}
-
-int LiveAudioEncoderAdapter::cpyToSamples(int16_t * samples, int samplesInShortCursor, int cpyPacketBufferSize, double* presentationTimeMills) {
-    if (0 == samplesInShortCursor) {
-        double packetBufferCursorDuration = (double)packetBufferCursor * 1000.0f / (double)(audioSampleRate * channelRatio);
-        (*presentationTimeMills) = packetBufferPresentationTimeMills + packetBufferCursorDuration;
+    this->discardAudioPacket();
+    int sampleSize = frame_size * nb_channels;
+    // 直接从 PCM 环形缓冲区读出编码器一帧大小的数据
+    int ret = pcmPacketPool->getAudioSamples(samples, sampleSize, presentationTimeMills, true);
+    if (ret < 0) {
+        return ret;
     }
-    memcpy(samples + samplesInShortCursor, packetBuffer + packetBufferCursor, cpyPacketBufferSize * sizeof(short));
-    return 1;
+    int actualSize = this->processAudio(samples, sampleSize);
+    return actualSize > 0 ? actualSize : -1;
 }
 
 void LiveAudioEncoderAdapter::discardAudioPacket() {
@@ -123,28 +98,3 @@ void LiveAudioEncoderAdapter::discardAudioPacket() {
         }
     }
 }
-
-int LiveAudioEncoderAdapter::getAudioPacket() {
-    this->discardAudioPacket();
-    LiveAudioPacket *audioPacket = NULL;
-    if (pcmPacketPool->getAudioPacket(&audioPacket, true) < 0) {
-        return -1;
-    }
-    packetBufferCursor = 0;
-    packetBufferPresentationTimeMills = audioPacket->position;
-    packetBufferSize = audioPacket->size * channelRatio;
-    if (NULL == packetBuffer) {
-        packetBuffer = new short[packetBufferSize];
-    }
-    memcpy(packetBuffer, audioPacket->buffer, audioPacket->size * sizeof(short));
-    int actualSize = this->processAudio();
-    if (actualSize > 0 && actualSize < packetBufferSize) {
-        packetBufferCursor = packetBufferSize - actualSize;
-        memmove(packetBuffer + packetBufferCursor, packetBuffer, actualSize * sizeof(short));
-    }
-    if (NULL != audioPacket) {
-        delete audioPacket;
-        audioPacket = NULL;
-    }
-    return actualSize > 0 ? 1 : -1;
-}
@@ -19,7 +19,7 @@ public:
     LiveAudioEncoderAdapter();
     virtual ~LiveAudioEncoderAdapter();
     
-    void init(LivePacketPool *pcmPacketPool, int audioSampleRate, int audioChannels, int audioBitRate, const char *audio_codec_name);
+    void init(LivePacketPool *pcmPacketPool, LiveAudioPacketPool *aacPacketPool, int audioSampleRate, int audioChannels, int audioBitRate, const char *audio_codec_name);
     virtual void destroy();
     
 protected:
@@ -31,24 +31,14 @@ protected:
     LivePacketPool *pcmPacketPool;
     LiveAudioPacketPool *aacPacketPool;
     
-    int packetBufferSize;
-    short *packetBuffer;
-    int packetBufferCursor;
     int audioSampleRate;
     int audioChannels;
     int audioBitRate;
     char *audioCodecName;
-    double packetBufferPresentationTimeMills;
     
-    float channelRatio;
-    
-
-    int cpyToSamples(int16_t * samples, int samplesInShortCursor, int cpyPacketBufferSize, double* presentationTimeMills);
-    
-    int getAudioPacket();
-    
-    virtual int processAudio() {
-        return packetBufferSize;
+    /* 在编码前处理一帧 PCM 数据，返回处理后的采样数 */
+    virtual int processAudio(int16_t *samples, int sampleSize) {
+        return sampleSize;
     }
     
     virtual void discardAudioPacket();
@@ -0,0 +1,207 @@
+//
+//  live_audio_jitter_buffer.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_audio_jitter_buffer.h"
+
+LiveAudioJitterBuffer::LiveAudioJitterBuffer(LivePCMRingBuffer *ring, int sampleRate, int channels, LiveAudioJitterConfig config) {
+    this->ring = ring;
+    this->sampleRate = sampleRate;
+    this->channels = channels;
+    this->config = config;
+    targetDepthMills = MAX(MIN(config.targetDepthMills, config.maxDepthMills), config.minDepthMills);
+    started = false;
+    startMills = 0;
+    pulledFrames = 0;
+    lastFrame = NULL;
+    lastFrameSize = 0;
+    lastTimeMills = -1;
+    concealRun = 0;
+    concealDebt = 0;
+    windowStartMills = 0;
+    windowMinDepth = INT32_MAX;
+    windowUnderrun = false;
+    mAbortRequest = false;
+    pthread_mutex_init(&mLock, NULL);
+    platform_4_live::initMonotonicCondition(&mCondition);
+    statDepthMills.store(0);
+    statTargetDepthMills.store(targetDepthMills);
+    statUnderrunCount.store(0);
+    statConcealedFrames.store(0);
+    statOverrunCount.store(0);
+    statTrimCount.store(0);
+    statDroppedFrames.store(0);
+}
+
+LiveAudioJitterBuffer::~LiveAudioJitterBuffer() {
+    if (NULL != lastFrame) {
+        delete[] lastFrame;
+    }
+    pthread_mutex_destroy(&mLock);
+    pthread_cond_destroy(&mCondition);
+}
+
+int LiveAudioJitterBuffer::millsToSamples(int mills) {
+    return (int)((int64_t)mills * sampleRate / 1000) * channels;
+}
+
+int LiveAudioJitterBuffer::samplesToMills(int sampleSize) {
+    return (int)((int64_t)sampleSize / channels * 1000 / sampleRate);
+}
+
+// 按采样数算出下一帧该出去的时间，不累积取整误差
+int64_t LiveAudioJitterBuffer::getDueMills() {
+    return startMills + pulledFrames * 1000 / sampleRate;
+}
+
+int LiveAudioJitterBuffer::sleepUntil(int64_t deadlineMills) {
+    pthread_mutex_lock(&mLock);
+    while (!mAbortRequest && ETIMEDOUT != platform_4_live::waitConditionUntil(&mCondition, &mLock, deadlineMills)) {
+    }
+    bool aborted = mAbortRequest;
+    pthread_mutex_unlock(&mLock);
+    return aborted ? -1 : 0;
+}
+
+int LiveAudioJitterBuffer::pull(short *samples, int sampleSize, double *timeMills) {
+    int frameCount = sampleSize / channels;
+    if (!started) {
+        // 先攒够目标深度，之后的节拍从这里开始算
+        int ret = ring->waitForSamples(millsToSamples(targetDepthMills) + sampleSize, -1);
+        if (ret < 0) {
+            return ret;
+        }
+        started = true;
+        startMills = platform_4_live::getMonotonicTimeMills();
+        windowStartMills = startMills;
+    }
+    // 编码跟不上或者节拍被提前时不等待，直接追
+    if (sleepUntil(getDueMills()) < 0) {
+        return -1;
+    }
+    pulledFrames += frameCount;
+    int ret = ring->waitForSamples(sampleSize, platform_4_live::getDeadlineMills(AUDIO_JITTER_LATE_TOLERANCE_MILLS));
+    if (ret < 0) {
+        return ret;
+    }
+    if (0 == ret) {
+        // 到点了数据还没到，用补偿帧顶上，记下欠账，迟到的数据到了之后丢掉同样多
+        conceal(samples, sampleSize);
+        concealDebt += sampleSize;
+        statUnderrunCount.fetch_add(1);
+        statConcealedFrames.fetch_add(frameCount);
+        windowUnderrun = true;
+        // 后面的节拍推迟，多等的这段时间里到的数据就是加出来的深度
+        int growMills = MIN(targetDepthMills + AUDIO_JITTER_GROW_STEP_MILLS, config.maxDepthMills) - targetDepthMills;
+        targetDepthMills += growMills;
+        startMills += growMills;
+        if (lastTimeMills >= 0) {
+            lastTimeMills += frameCount * 1000.0 / sampleRate;
+        }
+        if (NULL != timeMills) {
+            (*timeMills) = lastTimeMills;
+        }
+    } else {
+        if (concealDebt > 0) {
+            // 队头是补偿过的那段时间迟到的数据，至少留一帧给这次读
+            int repay = MIN(concealDebt, ring->size() - sampleSize);
+            concealDebt -= drop(repay);
+        }
+        ret = ring->read(samples, sampleSize, timeMills, false);
+        if (ret <= 0) {
+            return ret;
+        }
+        if (lastFrameSize < sampleSize) {
+            if (NULL != lastFrame) {
+                delete[] lastFrame;
+            }
+            lastFrame = new short[sampleSize];
+        }
+        lastFrameSize = sampleSize;
+        memcpy(lastFrame, samples, sampleSize * sizeof(short));
+        lastTimeMills = NULL != timeMills ? (*timeMills) : -1;
+        concealRun = 0;
+    }
+    adapt(sampleSize);
+    return sampleSize;
+}
+
+void LiveAudioJitterBuffer::conceal(short *samples, int sampleSize) {
+    if (NULL == lastFrame || lastFrameSize != sampleSize || concealRun >= AUDIO_JITTER_MAX_CONCEAL_FRAMES) {
+        memset(samples, 0, sampleSize * sizeof(short));
+        concealRun++;
+        return;
+    }
+    // 重复上一帧，增益每帧减半，帧内线性过渡，连续补偿几帧之后就是静音，不会有爆音
+    int frameCount = sampleSize / channels;
+    double startGain = 1.0 / (1 << concealRun);
+    double endGain = startGain / 2;
+    for (int i = 0; i < frameCount; i++) {
+        double gain = startGain + (endGain - startGain) * i / frameCount;
+        for (int c = 0; c < channels; c++) {
+            samples[i * channels + c] = (short)lrint(lastFrame[i * channels + c] * gain);
+        }
+    }
+    concealRun++;
+}
+
+void LiveAudioJitterBuffer::adapt(int sampleSize) {
+    int64_t now = platform_4_live::getMonotonicTimeMills();
+    // 节拍已经落后的部分马上会被连续取走，不算在深度里
+    int depth = ring->size() - millsToSamples((int)MAX(now - getDueMills(), 0));
+    int targetDepth = millsToSamples(targetDepthMills);
+    if (depth > millsToSamples(config.maxDepthMills)) {
+        // 积压超过上限，节拍提前，接下来几次 pull 不等待，把积压取到目标深度
+        startMills -= samplesToMills(depth - targetDepth);
+        statOverrunCount.fetch_add(1);
+        depth = targetDepth;
+    }
+    windowMinDepth = MIN(windowMinDepth, depth);
+    statDepthMills.store(samplesToMills(MAX(depth, 0)));
+    if (now - windowStartMills >= AUDIO_JITTER_ADAPT_WINDOW_MILLS) {
+        if (!windowUnderrun) {
+            targetDepthMills = MAX(targetDepthMills - AUDIO_JITTER_SHRINK_STEP_MILLS, config.minDepthMills);
+            targetDepth = millsToSamples(targetDepthMills);
+        }
+        // 整个窗口里都没用到的余量说明抖动没这么大，节拍提前把它取掉降低延迟
+        int excess = windowMinDepth - targetDepth;
+        if (excess >= sampleSize) {
+            startMills -= samplesToMills(excess);
+            statTrimCount.fetch_add(1);
+        }
+        windowStartMills = now;
+        windowMinDepth = INT32_MAX;
+        windowUnderrun = false;
+    }
+    statTargetDepthMills.store(targetDepthMills);
+}
+
+int LiveAudioJitterBuffer::drop(int sampleSize) {
+    sampleSize -= sampleSize % channels;
+    if (sampleSize <= 0 || ring->discard(sampleSize) <= 0) {
+        return 0;
+    }
+    statDroppedFrames.fetch_add(sampleSize / channels);
+    return sampleSize;
+}
+
+void LiveAudioJitterBuffer::abort() {
+    pthread_mutex_lock(&mLock);
+    mAbortRequest = true;
+    pthread_cond_broadcast(&mCondition);
+    pthread_mutex_unlock(&mLock);
+}
+
+void LiveAudioJitterBuffer::getStats(LiveAudioJitterStats *stats) {
+    stats->depthMills = statDepthMills.load();
+    stats->targetDepthMills = statTargetDepthMills.load();
+    stats->underrunCount = statUnderrunCount.load();
+    stats->concealedFrames = statConcealedFrames.load();
+    stats->overrunCount = statOverrunCount.load();
+    stats->trimCount = statTrimCount.load();
+    stats->droppedFrames = statDroppedFrames.load();
+}
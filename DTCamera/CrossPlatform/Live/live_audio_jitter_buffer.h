@@ -0,0 +1,107 @@
+//
+//  live_audio_jitter_buffer.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_audio_jitter_buffer_h
+#define live_audio_jitter_buffer_h
+
+#include "platform_4_live_common.h"
+#include "live_pcm_ring_buffer.h"
+#include <pthread.h>
+#include <atomic>
+
+#define AUDIO_JITTER_TARGET_DEPTH_MILLS                                      60
+#define AUDIO_JITTER_MIN_DEPTH_MILLS                                         20
+#define AUDIO_JITTER_MAX_DEPTH_MILLS                                         500
+#define AUDIO_JITTER_GROW_STEP_MILLS                                         20
+#define AUDIO_JITTER_SHRINK_STEP_MILLS                                       5
+#define AUDIO_JITTER_ADAPT_WINDOW_MILLS                                      2000
+#define AUDIO_JITTER_LATE_TOLERANCE_MILLS                                    5
+#define AUDIO_JITTER_MAX_CONCEAL_FRAMES                                      5
+
+/**
+ * 抖动缓冲的深度配置，targetDepthMills 是起始深度，之后在 [minDepthMills, maxDepthMills] 之间自适应
+ * 超过 maxDepthMills 的积压加快取走，取到目标深度为止
+ */
+typedef struct LiveAudioJitterConfig {
+    int targetDepthMills;
+    int minDepthMills;
+    int maxDepthMills;
+} LiveAudioJitterConfig;
+
+typedef struct LiveAudioJitterStats {
+    int depthMills;
+    int targetDepthMills;
+    int64_t underrunCount;       // 到点了数据还没到，用补偿帧顶上的次数
+    int64_t concealedFrames;     // 补偿出来的帧数（采样帧，不是编码帧）
+    int64_t overrunCount;        // 积压超过上限、节拍提前把积压取走的次数
+    int64_t trimCount;           // 一个窗口内一直用不到的余量被削掉的次数
+    int64_t droppedFrames;       // 补偿之后迟到的数据被丢掉的帧数，取完之后和 concealedFrames 相等
+} LiveAudioJitterStats;
+
+/**
+ * PCM 环形缓冲区和音频编码器之间的抖动缓冲
+ * 先攒够目标深度再开始输出，之后按单调时钟的节拍每帧取一次，采集回调的突发和迟到都被这段深度吸收，编码器拿到的是稳定的节拍
+ * 到点了数据还没到就用上一帧渐弱之后顶上，不让编码器停下来，迟到的数据到了之后丢掉同样多的采样
+ * 编码器按输出的采样数打时间戳，输出的第 n 个采样始终是采集的第 n 个，音视频不会因为补偿错开
+ * 所以深度只靠调整节拍来变：欠载时后面的节拍整体推迟来加深，有富余或者积压超限时节拍提前、连续取几次来变浅，不增删数据
+ * pull 只在编码线程调用，统计可以在任意线程读
+ */
+class LiveAudioJitterBuffer {
+public:
+    LiveAudioJitterBuffer(LivePCMRingBuffer *ring, int sampleRate, int channels, LiveAudioJitterConfig config);
+    ~LiveAudioJitterBuffer();
+
+    /* 编码线程：按节拍取 sampleSize 个采样，返回 < 0 if aborted, > 0 if read or concealed */
+    int pull(short *samples, int sampleSize, double *timeMills);
+    void abort();
+
+    void getStats(LiveAudioJitterStats *stats);
+
+private:
+    int sleepUntil(int64_t deadlineMills);
+    void conceal(short *samples, int sampleSize);
+    void adapt(int sampleSize);
+    int drop(int sampleSize);
+    int64_t getDueMills();
+    int millsToSamples(int mills);
+    int samplesToMills(int sampleSize);
+
+    LivePCMRingBuffer *ring;
+    int sampleRate;
+    int channels;
+    LiveAudioJitterConfig config;
+    int targetDepthMills;
+
+    bool started;
+    int64_t startMills;
+    int64_t pulledFrames;
+
+    short *lastFrame;
+    int lastFrameSize;
+    double lastTimeMills;
+    int concealRun;
+    int concealDebt; // 补偿出去还没有用迟到数据抵掉的采样数
+
+    int64_t windowStartMills;
+    int windowMinDepth;
+    bool windowUnderrun;
+
+    bool mAbortRequest;
+    pthread_mutex_t mLock;
+    pthread_cond_t mCondition;
+
+    std::atomic<int> statDepthMills;
+    std::atomic<int> statTargetDepthMills;
+    std::atomic<int64_t> statUnderrunCount;
+    std::atomic<int64_t> statConcealedFrames;
+    std::atomic<int64_t> statOverrunCount;
+    std::atomic<int64_t> statTrimCount;
+    std::atomic<int64_t> statDroppedFrames;
+};
+
+#endif /* live_audio_jitter_buffer_h */
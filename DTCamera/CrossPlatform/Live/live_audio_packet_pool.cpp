@@ -10,14 +10,12 @@
 
 LiveAudioPacketPool::LiveAudioPacketPool() {
     audioPacketQueue = NULL;
+    audioBufferPool = new LiveBufferPool("audio packet buffer pool");
 }
 
 LiveAudioPacketPool::~LiveAudioPacketPool() {
-}
-
-LiveAudioPacketPool* LiveAudioPacketPool::instance = new LiveAudioPacketPool();
-LiveAudioPacketPool* LiveAudioPacketPool::GetInstance() {
-    return instance;
+    // AAC 数据可能还挂在 muxer 的 AVPacket 上，交给引用计数释放
+    audioBufferPool->release();
 }
 
 void LiveAudioPacketPool::initAudioPacketQueue() {
@@ -46,8 +44,26 @@ int LiveAudioPacketPool::getAudioPacket(LiveAudioPacket **audioPacket, bool bloc
     return result;
 }
 
+int LiveAudioPacketPool::getAudioPackets(LiveAudioPacket **audioPackets, int maxCount, int maxWaitMills) {
+    int result = -1;
+    if (NULL != audioPacketQueue) {
+        result = audioPacketQueue->getBatch(audioPackets, maxCount, maxWaitMills);
+    }
+    return result;
+}
+
 int LiveAudioPacketPool::getAudioPacketQueueSize() {
-    return audioPacketQueue->size();
+    int size = 0;
+    if (NULL != audioPacketQueue) {
+        size = audioPacketQueue->size();
+    }
+    return size;
+}
+
+void LiveAudioPacketPool::setAudioPacketNotifier(LivePacketNotifier *notifier) {
+    if (NULL != audioPacketQueue) {
+        audioPacketQueue->setNotifier(notifier);
+    }
 }
 
 void LiveAudioPacketPool::pushAudioPacketToQueue(LiveAudioPacket *audioPacket) {
@@ -55,3 +71,11 @@ void LiveAudioPacketPool::pushAudioPacketToQueue(LiveAudioPacket *audioPacket) {
         audioPacketQueue->put(audioPacket);
     }
 }
+
+LiveAudioPacket* LiveAudioPacketPool::obtainAudioPacket(int size) {
+    LiveAudioPacket *audioPacket = new LiveAudioPacket();
+    audioPacket->bufferPool = audioBufferPool;
+    audioPacket->data = LiveAudioPacket::allocData(audioBufferPool, size);
+    audioPacket->size = size;
+    return audioPacket;
+}
@@ -11,22 +11,29 @@
 
 #include "live_audio_packet_queue.h"
 
+/**
+ * 一路推流会话的 AAC 包池，由会话创建并注入到编码和发送两侧，不同会话之间互不共享
+ */
 class LiveAudioPacketPool {
 protected:
-    LiveAudioPacketPool();
-    static LiveAudioPacketPool *instance;
     LiveAudioPacketQueue *audioPacketQueue;
+    LiveBufferPool *audioBufferPool;
     
 public:
-    static LiveAudioPacketPool* GetInstance();
+    LiveAudioPacketPool();
     virtual ~LiveAudioPacketPool();
     
     virtual void initAudioPacketQueue();
     virtual void abortAudioPacketQueue();
     virtual void destroyAudioPacketQueue();
     virtual int getAudioPacket(LiveAudioPacket **audioPacket, bool block);
+    virtual int getAudioPackets(LiveAudioPacket **audioPackets, int maxCount, int maxWaitMills);
     virtual void pushAudioPacketToQueue(LiveAudioPacket *audioPacket);
     virtual int getAudioPacketQueueSize();
+    virtual void setAudioPacketNotifier(LivePacketNotifier *notifier);
+    
+    /* 从 AAC 数据缓冲区池中借出 size 大小的 data 构造一个音频包，后面带 AUDIO_PACKET_PADDING_SIZE 个 0，包析构时归还 */
+    LiveAudioPacket* obtainAudioPacket(int size);
 };
 
 #endif /* live_audio_packet_pool_h */
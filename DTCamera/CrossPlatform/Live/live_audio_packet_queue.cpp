@@ -19,11 +19,12 @@ LiveAudioPacketQueue::LiveAudioPacketQueue(const char *queueNameParam) {
 
 void LiveAudioPacketQueue::init() {
     pthread_mutex_init(&mLock, NULL);
-    pthread_cond_init(&mCondition, NULL);
+    platform_4_live::initMonotonicCondition(&mCondition);
     mNbPackets = 0;
     mFrist = NULL;
     mLast = NULL;
     mAbortRequest = false;
+    mNotifier.store(NULL);
 }
 
 LiveAudioPacketQueue::~LiveAudioPacketQueue() {
@@ -81,36 +82,46 @@ int LiveAudioPacketQueue::put(LiveAudioPacket *pkt) {
     mNbPackets++;
     pthread_cond_signal(&mCondition);
     pthread_mutex_unlock(&mLock);
+    notifyArrival();
     return 0;
 }
 
 int LiveAudioPacketQueue::get(LiveAudioPacket **pkt, bool block) {
+    return getBatchUntil(pkt, 1, block ? -1 : 0);
+}
+
+int LiveAudioPacketQueue::getUntil(LiveAudioPacket **pkt, int64_t deadlineMills) {
+    return getBatchUntil(pkt, 1, deadlineMills);
+}
+
+int LiveAudioPacketQueue::getBatch(LiveAudioPacket **pkts, int maxCount, int maxWaitMills) {
+    return getBatchUntil(pkts, maxCount, platform_4_live::getDeadlineMills(maxWaitMills));
+}
+
+int LiveAudioPacketQueue::getBatchUntil(LiveAudioPacket **pkts, int maxCount, int64_t deadlineMills) {
     LiveAudioPacketList *pkt1;
-    int ret;
+    int ret = 0;
+    bool timeout = false;
     pthread_mutex_lock(&mLock);
     for (;;) {
         if (mAbortRequest) {
             ret = -1;
             break;
         }
-        pkt1 = mFrist;
-        if (pkt1) {
+        while (ret < maxCount && NULL != (pkt1 = mFrist)) {
             mFrist = pkt1->next;
             if (!mFrist) {
                 mLast = NULL;
             }
             mNbPackets--;
-            *pkt = pkt1->pkt;
+            pkts[ret++] = pkt1->pkt;
             delete pkt1;
-            pkt1 = NULL;
-            ret = 1;
-            break;
-        } else if (!block) {
-            ret = 0;
+        }
+        if (ret > 0 || timeout) {
             break;
-        } else {
-            pthread_cond_wait(&mCondition, &mLock);
         }
+        // 超时后最后再取一次
+        timeout = ETIMEDOUT == platform_4_live::waitConditionUntil(&mCondition, &mLock, deadlineMills);
     }
     pthread_mutex_unlock(&mLock);
     return ret;
@@ -119,6 +130,18 @@ int LiveAudioPacketQueue::get(LiveAudioPacket **pkt, bool block) {
 void LiveAudioPacketQueue::abort() {
     pthread_mutex_lock(&mLock);
     mAbortRequest = true;
-    pthread_cond_signal(&mCondition);
+    pthread_cond_broadcast(&mCondition);
     pthread_mutex_unlock(&mLock);
+    notifyArrival();
+}
+
+void LiveAudioPacketQueue::setNotifier(LivePacketNotifier *notifier) {
+    mNotifier.store(notifier);
+}
+
+void LiveAudioPacketQueue::notifyArrival() {
+    LivePacketNotifier *notifier = mNotifier.load(std::memory_order_acquire);
+    if (NULL != notifier) {
+        notifier->notify();
+    }
 }
@@ -10,20 +10,32 @@
 #define live_audio_packet_queue_h
 
 #include "platform_4_live_common.h"
+#include "live_packet_notifier.h"
+#include "live_buffer_pool.h"
 #include <pthread.h>
 
+#define AUDIO_PACKET_PADDING_SIZE                                       64 // 不小于 AV_INPUT_BUFFER_PADDING_SIZE，FFmpeg 的解析器和过滤器会读过 size
+
 typedef struct LiveAudioPacket {
     short *buffer;
     byte *data;
+    LiveBufferPool *bufferPool; // 不为空时 data 从这个池子借出
     int size;
-    float position;
+    double position;    // 毫秒，编码后的包由 pts 换算出来，只用来排序和比较
+    int64_t pts;        // 编码后的包以采样为单位的时间戳，时间基是 1/sampleRate，sampleRate 为 0 表示没有；编码器延迟的包可以是负数
+    int duration;       // 这个包包含的采样数
+    int sampleRate;
     long frameNum;
     
     LiveAudioPacket() {
         buffer = NULL;
         data = NULL;
+        bufferPool = NULL;
         size = 0;
         position = -1;
+        pts = -1;
+        duration = 0;
+        sampleRate = 0;
     }
     
     ~LiveAudioPacket() {
@@ -32,10 +44,50 @@ typedef struct LiveAudioPacket {
             buffer = NULL;
         }
         if (NULL != data) {
-            delete[] data;
+            if (NULL != bufferPool) {
+                bufferPool->recycle(data);
+            } else {
+                delete[] data;
+            }
             data = NULL;
         }
     }
+    
+    /* 编码数据后面带 AUDIO_PACKET_PADDING_SIZE 个 0，可以直接包成 AVPacket 交给 FFmpeg */
+    static byte* allocData(LiveBufferPool *pool, int size) {
+        byte *data = NULL != pool ? pool->obtain(size + AUDIO_PACKET_PADDING_SIZE) : new byte[size + AUDIO_PACKET_PADDING_SIZE];
+        memset(data + size, 0, AUDIO_PACKET_PADDING_SIZE);
+        return data;
+    }
+    
+    /* AAC 包很小，直接深拷贝 */
+    LiveAudioPacket* clone() {
+        LiveAudioPacket *result = new LiveAudioPacket();
+        if (NULL != buffer) {
+            result->buffer = new short[size];
+            memcpy(result->buffer, buffer, size * sizeof(short));
+        }
+        if (NULL != data) {
+            result->bufferPool = bufferPool;
+            result->data = allocData(bufferPool, size);
+            memcpy(result->data, data, size);
+        }
+        result->size = size;
+        result->position = position;
+        result->pts = pts;
+        result->duration = duration;
+        result->sampleRate = sampleRate;
+        result->frameNum = frameNum;
+        return result;
+    }
+    
+    /* 整数的采样时间戳是唯一的时间来源，毫秒位置从它换算，长时间推流不会累积误差 */
+    void setTimestamp(int64_t ptsParam, int durationParam, int sampleRateParam) {
+        pts = ptsParam;
+        duration = durationParam;
+        sampleRate = sampleRateParam;
+        position = sampleRate > 0 ? (double)pts * 1000.0 / (double)sampleRate : -1;
+    }
 } LiveAudioPacket;
 
 typedef struct LiveAudioPacketList {
@@ -69,16 +121,29 @@ public:
     int put(LiveAudioPacket *audioPacket);
     /* return < 0 if aborted, 0 if no packet and > 0 if packet. */
     int get(LiveAudioPacket **audioPacket, bool block);
+    /* 等到单调时钟的 deadlineMills（< 0 一直等），return < 0 if aborted, 0 if timeout and > 0 if packet. */
+    int getUntil(LiveAudioPacket **audioPacket, int64_t deadlineMills);
+    /**
+     * 一次加锁取出最多 maxCount 个包，队列为空时最多等待 maxWaitMills 毫秒（< 0 一直等，0 不等）
+     * return < 0 if aborted, 0 if timeout and > 0 the packet count.
+     */
+    int getBatch(LiveAudioPacket **audioPackets, int maxCount, int maxWaitMills);
+    int getBatchUntil(LiveAudioPacket **audioPackets, int maxCount, int64_t deadlineMills);
     int size();
     void abort();
+    /* 入队和 abort 时额外通知 notifier，发送线程可以同时等多个队列；传 NULL 取消 */
+    void setNotifier(LivePacketNotifier *notifier);
     
 private:
+    void notifyArrival();
+    
     LiveAudioPacketList *mFrist;
     LiveAudioPacketList *mLast;
     int mNbPackets;
     bool mAbortRequest;
     pthread_mutex_t mLock;
     pthread_cond_t mCondition;
+    std::atomic<LivePacketNotifier *> mNotifier;
     const char *queueName;
 };
 
@@ -0,0 +1,126 @@
+//
+//  live_bitrate_controller.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_bitrate_controller.h"
+
+LiveBitrateController::LiveBitrateController(int initialBitRate, int minBitRate, int maxBitRate, int frameRate, int minFrameRate) {
+    this->minBitRate = minBitRate > 0 ? minBitRate : initialBitRate;
+    this->maxBitRate = maxBitRate >= this->minBitRate ? maxBitRate : this->minBitRate;
+    this->initialBitRate = MAX(this->minBitRate, MIN(initialBitRate, this->maxBitRate));
+    this->maxFrameRate = frameRate;
+    this->minFrameRate = minFrameRate > 0 ? MIN(minFrameRate, frameRate) : frameRate;
+    onBitrateChangedCallback = NULL;
+    callbackContext = NULL;
+    reset();
+}
+
+void LiveBitrateController::registerBitrateChangedCallback(on_bitrate_changed_callback callback, void *context) {
+    this->onBitrateChangedCallback = callback;
+    this->callbackContext = context;
+}
+
+void LiveBitrateController::reset() {
+    targetBitRate = initialBitRate;
+    targetFrameRate = maxFrameRate;
+    estimatedBandwidth = -1;
+    lastBacklogMills = 0;
+    lastVideoDroppedMills = 0;
+    lastDecreaseTimeMills = -1;
+    clearSinceTimeMills = -1;
+}
+
+int LiveBitrateController::getTargetBitRate() {
+    return targetBitRate;
+}
+
+int LiveBitrateController::getTargetFrameRate() {
+    return targetFrameRate;
+}
+
+int LiveBitrateController::getEstimatedBandwidth() {
+    return estimatedBandwidth;
+}
+
+void LiveBitrateController::update(LiveBitrateSample *sample) {
+    int sendRate = sample->sendRateKbps * 1000;
+    // 封装好还没发出去的字节按当前的发送速率折算成时长，和视频队列的时长加在一起就是总的积压
+    int drainRate = sendRate > 0 ? sendRate : targetBitRate;
+    int ioBacklogMills = drainRate > 0 ? (int)((int64_t)sample->ioQueuedBytes * 8 * 1000 / drainRate) : 0;
+    int backlogMills = sample->videoQueueDurationMills + ioBacklogMills;
+    int growthMills = backlogMills - lastBacklogMills;
+    bool dropped = sample->videoDroppedMills > lastVideoDroppedMills;
+    lastBacklogMills = backlogMills;
+    lastVideoDroppedMills = sample->videoDroppedMills;
+
+    // 有积压时链路是跑满的，发送速率就是可用带宽；没有积压时发送速率只说明带宽至少有这么多
+    if (backlogMills > ABR_CLEAR_BACKLOG_MILLS) {
+        if (estimatedBandwidth < 0) {
+            estimatedBandwidth = sendRate;
+        } else {
+            estimatedBandwidth += (int)((int64_t)(sendRate - estimatedBandwidth) * ABR_BANDWIDTH_SMOOTH_PERCENT / 100);
+        }
+    } else if (estimatedBandwidth >= 0 && sendRate > estimatedBandwidth) {
+        estimatedBandwidth = sendRate;
+    }
+
+    if (backlogMills > ABR_CONGESTED_BACKLOG_MILLS || growthMills > ABR_CONGESTED_GROWTH_MILLS || dropped) {
+        clearSinceTimeMills = -1;
+        if (lastDecreaseTimeMills < 0 || sample->timeMills - lastDecreaseTimeMills >= ABR_DECREASE_HOLD_MILLS) {
+            printf("LiveBitrateController congested backlog %d ms growth %d ms dropped %d send rate %d kbps\n",
+                   backlogMills, growthMills, dropped ? 1 : 0, sample->sendRateKbps);
+            decrease(sample->timeMills);
+        }
+    } else if (backlogMills < ABR_CLEAR_BACKLOG_MILLS && growthMills <= 0) {
+        if (clearSinceTimeMills < 0) {
+            clearSinceTimeMills = sample->timeMills;
+        } else if (sample->timeMills - clearSinceTimeMills >= ABR_INCREASE_HOLD_MILLS) {
+            increase(sample->timeMills);
+        }
+    } else {
+        // 高低水位之间保持不动
+        clearSinceTimeMills = -1;
+    }
+}
+
+void LiveBitrateController::decrease(int64_t now) {
+    lastDecreaseTimeMills = now;
+    if (targetBitRate > minBitRate) {
+        int bitRate = (int)((int64_t)targetBitRate * ABR_DECREASE_PERCENT / 100);
+        if (estimatedBandwidth > 0) {
+            bitRate = MIN(bitRate, (int)((int64_t)estimatedBandwidth * ABR_BANDWIDTH_USAGE_PERCENT / 100));
+        }
+        targetBitRate = MAX(bitRate, minBitRate);
+    } else if (targetFrameRate > minFrameRate) {
+        // 码率已经到下限，再降帧率，每次降到 2/3
+        targetFrameRate = MAX(targetFrameRate * 2 / 3, minFrameRate);
+    } else {
+        return;
+    }
+    notifyChanged();
+}
+
+void LiveBitrateController::increase(int64_t now) {
+    clearSinceTimeMills = now;
+    if (targetFrameRate < maxFrameRate) {
+        targetFrameRate = MIN(targetFrameRate * 3 / 2, maxFrameRate);
+    } else if (targetBitRate < maxBitRate) {
+        int step = MAX((int)((int64_t)targetBitRate * ABR_INCREASE_PERCENT / 100), 1);
+        targetBitRate = MIN(targetBitRate + step, maxBitRate);
+    } else {
+        return;
+    }
+    notifyChanged();
+}
+
+void LiveBitrateController::notifyChanged() {
+    printf("LiveBitrateController target bit rate %d frame rate %d estimated bandwidth %d\n",
+           targetBitRate, targetFrameRate, estimatedBandwidth);
+    if (NULL != onBitrateChangedCallback) {
+        onBitrateChangedCallback(targetBitRate, targetFrameRate, callbackContext);
+    }
+}
@@ -0,0 +1,78 @@
+//
+//  live_bitrate_controller.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_bitrate_controller_h
+#define live_bitrate_controller_h
+
+#include "platform_4_live_common.h"
+
+#define ABR_UPDATE_INTERVAL_MILLS                                       1000
+#define ABR_CONGESTED_BACKLOG_MILLS                                     800  // 积压超过这个时长认为拥塞
+#define ABR_CLEAR_BACKLOG_MILLS                                         200  // 积压低于这个时长认为通畅
+#define ABR_CONGESTED_GROWTH_MILLS                                      300  // 一个周期里积压涨了这么多也认为拥塞
+#define ABR_DECREASE_PERCENT                                            80   // 降码率时至少降到当前的 80%
+#define ABR_BANDWIDTH_USAGE_PERCENT                                     85   // 降码率时不超过估计带宽的 85%，留出排空积压的余量
+#define ABR_INCREASE_PERCENT                                            8    // 升码率每次升 8%
+#define ABR_DECREASE_HOLD_MILLS                                         2000 // 两次降码率之间至少间隔，等编码器的新码率生效
+#define ABR_INCREASE_HOLD_MILLS                                         5000 // 持续通畅这么久才升一档
+#define ABR_BANDWIDTH_SMOOTH_PERCENT                                    30   // 带宽估计的指数平滑系数
+
+/** 一个周期的观测值，由发送线程在心跳里采集 **/
+typedef struct LiveBitrateSample {
+    int64_t timeMills;
+    int sendRateKbps;              // 这一秒实际写到网络上的速率
+    int ioQueuedBytes;             // 已经封装好、还没写到网络上的字节数
+    int videoQueueDurationMills;   // 视频队列里还没封装的时长
+    int64_t videoDroppedMills;     // 累计丢掉的视频时长
+} LiveBitrateSample;
+
+typedef void (*on_bitrate_changed_callback)(int bitRate, int frameRate, void *context);
+
+/**
+ * 按照发送积压和实际吞吐调整编码码率
+ * 积压超过高水位、积压在涨或者出现丢帧时按估计的带宽降码率，码率降到下限还拥塞就降帧率
+ * 积压持续低于低水位一段时间后先恢复帧率，再按小步长升码率，高低水位和等待时间一起做迟滞，避免来回抖动
+ * 只在发送线程里调用 update，回调也在发送线程里
+ */
+class LiveBitrateController {
+public:
+    LiveBitrateController(int initialBitRate, int minBitRate, int maxBitRate, int frameRate, int minFrameRate);
+    
+    void registerBitrateChangedCallback(on_bitrate_changed_callback callback, void *context);
+    
+    void reset();
+    void update(LiveBitrateSample *sample);
+    
+    int getTargetBitRate();
+    int getTargetFrameRate();
+    int getEstimatedBandwidth();
+    
+private:
+    void decrease(int64_t now);
+    void increase(int64_t now);
+    void notifyChanged();
+    
+    int initialBitRate;
+    int minBitRate;
+    int maxBitRate;
+    int maxFrameRate;
+    int minFrameRate;
+    
+    int targetBitRate;
+    int targetFrameRate;
+    int estimatedBandwidth; // bps，-1 表示还没有估计
+    int lastBacklogMills;
+    int64_t lastVideoDroppedMills;
+    int64_t lastDecreaseTimeMills;
+    int64_t clearSinceTimeMills; // -1 表示当前不通畅
+    
+    on_bitrate_changed_callback onBitrateChangedCallback;
+    void *callbackContext;
+};
+
+#endif /* live_bitrate_controller_h */
@@ -0,0 +1,152 @@
+//
+//  live_buffer_pool.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_buffer_pool.h"
+
+// 每个缓冲区前面放一个头，记录大小级别和容量，保持数据 16 字节对齐
+#define BUFFER_POOL_HEADER_SIZE                                         16
+
+typedef struct LiveBufferHeader {
+    int sizeClass;
+    int capacity;
+} LiveBufferHeader;
+
+static inline LiveBufferHeader* headerOf(byte *buffer) {
+    return (LiveBufferHeader *)(buffer - BUFFER_POOL_HEADER_SIZE);
+}
+
+LiveBufferPool::LiveBufferPool(const char *poolNameParam) {
+    poolName = poolNameParam;
+    refCount.store(1, std::memory_order_relaxed);
+    for (int i = 0; i < BUFFER_POOL_CLASS_COUNT; i++) {
+        classes[i].count = 0;
+        pthread_mutex_init(&classes[i].lock, NULL);
+    }
+    obtainCount.store(0);
+    hitCount.store(0);
+    recycleCount.store(0);
+    outstandingBytes.store(0);
+    highWaterBytes.store(0);
+    cachedBytes.store(0);
+}
+
+LiveBufferPool::~LiveBufferPool() {
+    dumpStats();
+    for (int i = 0; i < BUFFER_POOL_CLASS_COUNT; i++) {
+        for (int j = 0; j < classes[i].count; j++) {
+            delete[] (classes[i].buffers[j] - BUFFER_POOL_HEADER_SIZE);
+        }
+        classes[i].count = 0;
+        pthread_mutex_destroy(&classes[i].lock);
+    }
+}
+
+LiveBufferPool* LiveBufferPool::retain() {
+    refCount.fetch_add(1, std::memory_order_relaxed);
+    return this;
+}
+
+void LiveBufferPool::release() {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete this;
+    }
+}
+
+int LiveBufferPool::maxCachedOf(int sizeClass) {
+    int capacity = 1 << (sizeClass + BUFFER_POOL_MIN_CLASS_SHIFT);
+    return MAX(MIN(BUFFER_POOL_MAX_CACHED_PER_CLASS, BUFFER_POOL_MAX_CACHED_BYTES_PER_CLASS / capacity), 1);
+}
+
+int LiveBufferPool::sizeClassOf(int size) {
+    int shift = BUFFER_POOL_MIN_CLASS_SHIFT;
+    while (shift <= BUFFER_POOL_MAX_CLASS_SHIFT && (1 << shift) < size) {
+        shift++;
+    }
+    if (shift > BUFFER_POOL_MAX_CLASS_SHIFT) {
+        return -1;
+    }
+    return shift - BUFFER_POOL_MIN_CLASS_SHIFT;
+}
+
+void LiveBufferPool::updateHighWater(int64_t outstanding) {
+    int64_t highWater = highWaterBytes.load(std::memory_order_relaxed);
+    while (outstanding > highWater && !highWaterBytes.compare_exchange_weak(highWater, outstanding)) {
+    }
+}
+
+byte* LiveBufferPool::obtain(int size) {
+    obtainCount++;
+    int sizeClass = sizeClassOf(size);
+    byte *buffer = NULL;
+    if (sizeClass >= 0) {
+        BufferClass *bufferClass = &classes[sizeClass];
+        pthread_mutex_lock(&bufferClass->lock);
+        if (bufferClass->count > 0) {
+            buffer = bufferClass->buffers[--bufferClass->count];
+        }
+        pthread_mutex_unlock(&bufferClass->lock);
+    }
+    int capacity = sizeClass >= 0 ? (1 << (sizeClass + BUFFER_POOL_MIN_CLASS_SHIFT)) : size;
+    if (NULL != buffer) {
+        hitCount++;
+        cachedBytes -= capacity;
+    } else {
+        buffer = new byte[capacity + BUFFER_POOL_HEADER_SIZE] + BUFFER_POOL_HEADER_SIZE;
+        LiveBufferHeader *header = headerOf(buffer);
+        header->sizeClass = sizeClass;
+        header->capacity = capacity;
+    }
+    updateHighWater(outstandingBytes += capacity);
+    // 借出去的缓冲区让池子活到它还回来为止
+    retain();
+    return buffer;
+}
+
+void LiveBufferPool::recycle(byte *buffer) {
+    if (NULL == buffer) {
+        return;
+    }
+    recycleCount++;
+    LiveBufferHeader *header = headerOf(buffer);
+    outstandingBytes -= header->capacity;
+    bool cached = false;
+    if (header->sizeClass >= 0) {
+        BufferClass *bufferClass = &classes[header->sizeClass];
+        pthread_mutex_lock(&bufferClass->lock);
+        if (bufferClass->count < maxCachedOf(header->sizeClass)) {
+            bufferClass->buffers[bufferClass->count++] = buffer;
+            cached = true;
+        }
+        pthread_mutex_unlock(&bufferClass->lock);
+    }
+    if (cached) {
+        cachedBytes += header->capacity;
+    } else {
+        delete[] (buffer - BUFFER_POOL_HEADER_SIZE);
+    }
+    // 可能是最后一个引用，之后不能再访问成员
+    release();
+}
+
+void LiveBufferPool::getStats(LiveBufferPoolStats *stats) {
+    stats->obtainCount = obtainCount.load();
+    stats->hitCount = hitCount.load();
+    stats->recycleCount = recycleCount.load();
+    stats->outstandingBytes = outstandingBytes.load();
+    stats->highWaterBytes = highWaterBytes.load();
+    stats->cachedBytes = cachedBytes.load();
+}
+
+void LiveBufferPool::dumpStats() {
+    LiveBufferPoolStats stats;
+    getStats(&stats);
+    double hitRate = stats.obtainCount > 0 ? (double)stats.hitCount * 100.0 / (double)stats.obtainCount : 0.0;
+    printf("%s obtain %lld hit rate %.2f%% outstanding %lld high water %lld cached %lld\n", poolName,
+           (long long)stats.obtainCount, hitRate, (long long)stats.outstandingBytes,
+           (long long)stats.highWaterBytes, (long long)stats.cachedBytes);
+}
@@ -0,0 +1,75 @@
+//
+//  live_buffer_pool.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_buffer_pool_h
+#define live_buffer_pool_h
+
+#include "platform_4_live_common.h"
+#include <pthread.h>
+#include <atomic>
+
+#define BUFFER_POOL_MIN_CLASS_SHIFT                                     10  // 1KB
+#define BUFFER_POOL_MAX_CLASS_SHIFT                                     22  // 4MB
+#define BUFFER_POOL_CLASS_COUNT                                         (BUFFER_POOL_MAX_CLASS_SHIFT - BUFFER_POOL_MIN_CLASS_SHIFT + 1)
+#define BUFFER_POOL_MAX_CACHED_PER_CLASS                                32
+#define BUFFER_POOL_MAX_CACHED_BYTES_PER_CLASS                          (2 * 1024 * 1024)  // 大的级别按字节数限制缓存个数，至少留一个
+
+typedef struct LiveBufferPoolStats {
+    int64_t obtainCount;
+    int64_t hitCount;
+    int64_t recycleCount;
+    int64_t outstandingBytes;
+    int64_t highWaterBytes; // 同时借出的字节数的最大值
+    int64_t cachedBytes;
+} LiveBufferPoolStats;
+
+/**
+ * 按 2 的幂分级的缓冲区池，线程安全
+ * 超过最大级别的请求直接向系统申请，归还时直接释放
+ * 池子有引用计数：创建者持有一个，每个借出去还没还回来的缓冲区各持有一个；
+ * 创建者用 release 代替 delete，缓冲区可能还在 muxer 手里，最后一个缓冲区还回来时池子才真正释放
+ */
+class LiveBufferPool {
+public:
+    LiveBufferPool(const char *poolNameParam);
+    
+    LiveBufferPool* retain();
+    void release();
+
+    byte *obtain(int size);
+    void recycle(byte *buffer);
+
+    void getStats(LiveBufferPoolStats *stats);
+    void dumpStats();
+
+private:
+    ~LiveBufferPool();
+    
+    typedef struct BufferClass {
+        byte *buffers[BUFFER_POOL_MAX_CACHED_PER_CLASS];
+        int count;
+        pthread_mutex_t lock;
+    } BufferClass;
+
+    BufferClass classes[BUFFER_POOL_CLASS_COUNT];
+    const char *poolName;
+    std::atomic<int> refCount;
+
+    std::atomic<int64_t> obtainCount;
+    std::atomic<int64_t> hitCount;
+    std::atomic<int64_t> recycleCount;
+    std::atomic<int64_t> outstandingBytes;
+    std::atomic<int64_t> highWaterBytes;
+    std::atomic<int64_t> cachedBytes;
+
+    static int sizeClassOf(int size);
+    static int maxCachedOf(int sizeClass);
+    void updateHighWater(int64_t outstanding);
+};
+
+#endif /* live_buffer_pool_h */
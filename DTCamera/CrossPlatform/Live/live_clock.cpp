@@ -0,0 +1,50 @@
+//
+//  live_clock.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_clock.h"
+#include <time.h>
+#include <stddef.h>
+
+static LiveMonotonicClock monotonicClock;
+
+std::atomic<LiveClock *> LiveClock::sClock(NULL);
+
+LiveClock* LiveClock::getClock() {
+    LiveClock *clock = sClock.load(std::memory_order_acquire);
+    return NULL != clock ? clock : &monotonicClock;
+}
+
+void LiveClock::setClock(LiveClock *clock) {
+    sClock.store(clock, std::memory_order_release);
+}
+
+int64_t LiveMonotonicClock::getTimeNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+LiveVirtualClock::LiveVirtualClock(int64_t startNanos) {
+    mNanos.store(startNanos);
+}
+
+int64_t LiveVirtualClock::getTimeNanos() {
+    return mNanos.load(std::memory_order_acquire);
+}
+
+void LiveVirtualClock::advanceNanos(int64_t nanos) {
+    mNanos.fetch_add(nanos, std::memory_order_acq_rel);
+}
+
+void LiveVirtualClock::advanceMills(int64_t mills) {
+    advanceNanos(mills * 1000000LL);
+}
+
+void LiveVirtualClock::setTimeNanos(int64_t nanos) {
+    mNanos.store(nanos, std::memory_order_release);
+}
@@ -0,0 +1,56 @@
+//
+//  live_clock.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_clock_h
+#define live_clock_h
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * Live 层所有计时用的时间源，纳秒精度
+ * 默认是 CLOCK_MONOTONIC，不受系统时间修改和 NTP 校时的影响
+ * 压测和模拟时可以换成 LiveVirtualClock，由驱动方推进时间，整条流水线跑得比真实时间快并且结果可复现
+ */
+class LiveClock {
+public:
+    virtual ~LiveClock() {}
+
+    virtual int64_t getTimeNanos() = 0;
+    /* 虚拟时钟的时间不随真实时间流逝，定时等待不能按真实时间睡满 */
+    virtual bool isVirtual() { return false; }
+
+    static LiveClock* getClock();
+    /* 传 NULL 恢复成 CLOCK_MONOTONIC，要在推流开始之前替换，不接管 clock */
+    static void setClock(LiveClock *clock);
+
+private:
+    static std::atomic<LiveClock *> sClock;
+};
+
+class LiveMonotonicClock : public LiveClock {
+public:
+    virtual int64_t getTimeNanos();
+};
+
+class LiveVirtualClock : public LiveClock {
+public:
+    LiveVirtualClock(int64_t startNanos);
+
+    virtual int64_t getTimeNanos();
+    virtual bool isVirtual() { return true; }
+
+    void advanceNanos(int64_t nanos);
+    void advanceMills(int64_t mills);
+    void setTimeNanos(int64_t nanos);
+
+private:
+    std::atomic<int64_t> mNanos;
+};
+
+#endif /* live_clock_h */
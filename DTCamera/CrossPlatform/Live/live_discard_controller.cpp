@@ -0,0 +1,61 @@
+//
+//  live_discard_controller.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_discard_controller.h"
+
+LiveDiscardController::LiveDiscardController() {
+    reset();
+}
+
+void LiveDiscardController::reset() {
+    debtMills.store(0);
+    videoDroppedMills.store(0);
+    videoDropCount.store(0);
+    audioDroppedMills.store(0);
+    audioDropCount.store(0);
+}
+
+void LiveDiscardController::recordVideoDrop(int durationMills) {
+    if (durationMills <= 0) {
+        return;
+    }
+    videoDroppedMills.fetch_add(durationMills, std::memory_order_relaxed);
+    videoDropCount.fetch_add(1, std::memory_order_relaxed);
+    debtMills.fetch_add(durationMills, std::memory_order_release);
+}
+
+bool LiveDiscardController::hasAudioDebt(int durationMills) {
+    return debtMills.load(std::memory_order_acquire) >= durationMills;
+}
+
+void LiveDiscardController::recordAudioDrop(int durationMills) {
+    audioDroppedMills.fetch_add(durationMills, std::memory_order_relaxed);
+    audioDropCount.fetch_add(1, std::memory_order_relaxed);
+    debtMills.fetch_sub(durationMills, std::memory_order_release);
+}
+
+int64_t LiveDiscardController::getOutstandingDebtMills() {
+    return debtMills.load(std::memory_order_acquire);
+}
+
+void LiveDiscardController::getStats(LiveDiscardStats *stats) {
+    stats->videoDroppedMills = videoDroppedMills.load(std::memory_order_relaxed);
+    stats->videoDropCount = videoDropCount.load(std::memory_order_relaxed);
+    stats->audioDroppedMills = audioDroppedMills.load(std::memory_order_relaxed);
+    stats->audioDropCount = audioDropCount.load(std::memory_order_relaxed);
+    stats->outstandingDebtMills = debtMills.load(std::memory_order_acquire);
+}
+
+void LiveDiscardController::dumpStats() {
+    LiveDiscardStats stats;
+    getStats(&stats);
+    printf("LiveDiscardController video dropped %lld ms (%lld), audio dropped %lld ms (%lld), outstanding debt %lld ms\n",
+           (long long)stats.videoDroppedMills, (long long)stats.videoDropCount,
+           (long long)stats.audioDroppedMills, (long long)stats.audioDropCount,
+           (long long)stats.outstandingDebtMills);
+}
@@ -0,0 +1,52 @@
+//
+//  live_discard_controller.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_discard_controller_h
+#define live_discard_controller_h
+
+#include "platform_4_live_common.h"
+#include <atomic>
+
+typedef struct LiveDiscardStats {
+    int64_t videoDroppedMills;
+    int64_t videoDropCount;
+    int64_t audioDroppedMills;
+    int64_t audioDropCount;
+    int64_t outstandingDebtMills; // 视频丢了但音频还没跟着丢的时长
+} LiveDiscardStats;
+
+/**
+ * 音视频丢弃的记账，视频丢掉多少时长，音频就要跟着丢掉多少，保持音画同步
+ * 视频生产者线程记入欠账，音频编码线程按包的粒度还账，全部是原子操作不加锁
+ */
+class LiveDiscardController {
+public:
+    LiveDiscardController();
+    
+    void reset();
+    
+    /* 视频生产者：丢掉了 durationMills 的视频 */
+    void recordVideoDrop(int durationMills);
+    /* 音频编码线程：欠账是否够丢一个 durationMills 的音频包 */
+    bool hasAudioDebt(int durationMills);
+    /* 音频编码线程：丢掉了 durationMills 的音频 */
+    void recordAudioDrop(int durationMills);
+    
+    int64_t getOutstandingDebtMills();
+    void getStats(LiveDiscardStats *stats);
+    void dumpStats();
+    
+private:
+    std::atomic<int64_t> debtMills;
+    std::atomic<int64_t> videoDroppedMills;
+    std::atomic<int64_t> videoDropCount;
+    std::atomic<int64_t> audioDroppedMills;
+    std::atomic<int64_t> audioDropCount;
+};
+
+#endif /* live_discard_controller_h */
@@ -0,0 +1,255 @@
+//
+//  live_fanout_publisher.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_fanout_publisher.h"
+
+LiveFanoutAudioPacketPool::LiveFanoutAudioPacketPool(LiveFanoutPublisher *publisher) {
+    this->publisher = publisher;
+}
+
+LiveFanoutAudioPacketPool::~LiveFanoutAudioPacketPool() {
+}
+
+void LiveFanoutAudioPacketPool::pushAudioPacketToQueue(LiveAudioPacket *audioPacket) {
+    publisher->pushAudioPacket(audioPacket);
+}
+
+static int on_destination_timeout_callback(void *context) {
+    LiveFanoutDestination *destination = (LiveFanoutDestination *)context;
+    return destination->publisher->onDestinationTimeout(destination);
+}
+
+LiveFanoutPublisher::LiveFanoutPublisher() {
+    destinationCount = 0;
+    audioPacketPool = new LiveFanoutAudioPacketPool(this);
+    audioCodecName = NULL;
+    audioPacketDurationMills = 0;
+    isStarted = false;
+    isStopping = false;
+    onPublishTimeoutCallback = NULL;
+    timeoutContext = NULL;
+    bitrateController = NULL;
+    videoCodec = LIVE_VIDEO_CODEC_H264;
+    pthread_mutex_init(&stateLock, NULL);
+}
+
+LiveFanoutPublisher::~LiveFanoutPublisher() {
+    stop();
+    for (int i = 0; i < destinationCount; i++) {
+        LiveFanoutDestination *destination = destinations[i];
+        delete destination->consumer;
+        delete destination->packetPool;
+        delete destination->aacPacketPool;
+        free(destination->uri);
+        pthread_mutex_destroy(&destination->queueLock);
+        delete destination;
+    }
+    destinationCount = 0;
+    delete audioPacketPool;
+    if (NULL != audioCodecName) {
+        free(audioCodecName);
+        audioCodecName = NULL;
+    }
+    pthread_mutex_destroy(&stateLock);
+}
+
+int LiveFanoutPublisher::addDestination(const char *uri) {
+    if (destinationCount >= FANOUT_MAX_DESTINATIONS) {
+        printf("LiveFanoutPublisher too many destinations, ignore %s\n", uri);
+        return -1;
+    }
+    LiveFanoutDestination *destination = new LiveFanoutDestination();
+    destination->index = destinationCount;
+    destination->uri = strdup(uri);
+    destination->packetPool = new LivePacketPool();
+    destination->aacPacketPool = new LiveAudioPacketPool();
+    destination->consumer = new VideoConsumerThread();
+    destination->active.store(false);
+    pthread_mutex_init(&destination->queueLock, NULL);
+    destination->started = false;
+    destination->initCode = -1;
+    destination->publisher = this;
+    destinations[destinationCount] = destination;
+    return destinationCount++;
+}
+
+int LiveFanoutPublisher::getDestinationCount() {
+    return destinationCount;
+}
+
+LivePacketPool* LiveFanoutPublisher::getPacketPool(int index) {
+    if (index < 0 || index >= destinationCount) {
+        return NULL;
+    }
+    return destinations[index]->packetPool;
+}
+
+LiveAudioPacketPool* LiveFanoutPublisher::getAudioPacketPool() {
+    return audioPacketPool;
+}
+
+void LiveFanoutPublisher::registerPublishTimeoutCallback(int (*on_publish_timeout_callback)(void *), void *context) {
+    this->onPublishTimeoutCallback = on_publish_timeout_callback;
+    this->timeoutContext = context;
+}
+
+void LiveFanoutPublisher::setBitrateController(LiveBitrateController *controller) {
+    this->bitrateController = controller;
+}
+
+void LiveFanoutPublisher::setVideoCodec(int videoCodec) {
+    this->videoCodec = videoCodec;
+}
+
+void* LiveFanoutPublisher::startConnectThread(void *ptr) {
+    LiveFanoutDestination *destination = (LiveFanoutDestination *)ptr;
+    destination->publisher->connect(destination);
+    pthread_exit(0);
+    return 0;
+}
+
+void LiveFanoutPublisher::connect(LiveFanoutDestination *destination) {
+    destination->consumer->setVideoCodec(videoCodec);
+    destination->initCode = destination->consumer->init(destination->packetPool, destination->aacPacketPool, destination->uri,
+                                                        videoWidth, videoHeight, videoFrameRate, videoBitRate,
+                                                        audioSampleRate, audioChannels, audioBitRate, audioCodecName);
+    printf("LiveFanoutPublisher destination %d %s init return code %d\n", destination->index, destination->uri, destination->initCode);
+    if (destination->initCode < 0) {
+        deactivate(destination);
+        return;
+    }
+    pthread_mutex_lock(&stateLock);
+    if (!isStopping) {
+        destination->consumer->registerPublishTimeoutCallback(on_destination_timeout_callback, destination);
+        if (0 == destination->index && NULL != bitrateController) {
+            destination->consumer->setBitrateController(bitrateController);
+        }
+        destination->consumer->startAsync();
+    } else {
+        deactivate(destination);
+    }
+    pthread_mutex_unlock(&stateLock);
+}
+
+int LiveFanoutPublisher::start(int videoWidth, int videoHeight, int videoFrameRate, int videoBitRate,
+                               int audioSampleRate, int audioChannels, int audioBitRate, const char *audioCodecName) {
+    this->videoWidth = videoWidth;
+    this->videoHeight = videoHeight;
+    this->videoFrameRate = videoFrameRate;
+    this->videoBitRate = videoBitRate;
+    this->audioSampleRate = audioSampleRate;
+    this->audioChannels = audioChannels;
+    this->audioBitRate = audioBitRate;
+    pthread_mutex_lock(&stateLock);
+    if (isStopping) {
+        // start 还没开始就已经被 stop 了
+        pthread_mutex_unlock(&stateLock);
+        return -1;
+    }
+    isStarted = true;
+    pthread_mutex_unlock(&stateLock);
+    this->audioCodecName = strdup(audioCodecName);
+    // 一个 AAC 包 1024 个采样
+    this->audioPacketDurationMills = audioSampleRate > 0 ? 1024 * 1000 / audioSampleRate : 0;
+    for (int i = 0; i < destinationCount; i++) {
+        LiveFanoutDestination *destination = destinations[i];
+        destination->packetPool->initRecordingVideoPacketQueue();
+        destination->aacPacketPool->initAudioPacketQueue();
+        // 连接期间就开始接收数据，SPS/PPS 这种只来一次的包不会丢
+        destination->active.store(true);
+        destination->started = pthread_create(&destination->connectThread, NULL, startConnectThread, destination) == 0;
+    }
+    int connectedCount = 0;
+    for (int i = 0; i < destinationCount; i++) {
+        LiveFanoutDestination *destination = destinations[i];
+        if (destination->started) {
+            pthread_join(destination->connectThread, 0);
+            destination->started = false;
+        }
+        if (destination->active.load()) {
+            connectedCount++;
+        } else {
+            // 连接失败的输出不再往里推数据
+            releaseQueues(destination);
+        }
+    }
+    if (destinationCount > 0 && !destinations[0]->active.load()) {
+        return destinations[0]->initCode < 0 ? destinations[0]->initCode : -1;
+    }
+    return connectedCount;
+}
+
+void LiveFanoutPublisher::stop() {
+    pthread_mutex_lock(&stateLock);
+    bool needStop = isStarted && !isStopping;
+    isStopping = true;
+    pthread_mutex_unlock(&stateLock);
+    if (!needStop) {
+        return;
+    }
+    for (int i = 0; i < destinationCount; i++) {
+        LiveFanoutDestination *destination = destinations[i];
+        // 发送线程停下来的时候会销毁队列，先保证没有线程还在往里推
+        deactivate(destination);
+        // 正在连接的会被打断，还没开始连接的不会再连，已经在发送的会停掉发送线程并释放队列
+        // 返回之后连接线程不会再碰队列，线程本身由 start 去 join
+        destination->consumer->stop();
+        releaseQueues(destination);
+    }
+}
+
+void LiveFanoutPublisher::deactivate(LiveFanoutDestination *destination) {
+    pthread_mutex_lock(&destination->queueLock);
+    destination->active.store(false);
+    pthread_mutex_unlock(&destination->queueLock);
+}
+
+void LiveFanoutPublisher::releaseQueues(LiveFanoutDestination *destination) {
+    pthread_mutex_lock(&destination->queueLock);
+    destination->active.store(false);
+    destination->packetPool->destroyRecordingVideoPacketQueue();
+    destination->aacPacketPool->destroyAudioPacketQueue();
+    pthread_mutex_unlock(&destination->queueLock);
+}
+
+int LiveFanoutPublisher::onDestinationTimeout(LiveFanoutDestination *destination) {
+    printf("LiveFanoutPublisher destination %d %s timeout\n", destination->index, destination->uri);
+    deactivate(destination);
+    if (0 == destination->index && NULL != onPublishTimeoutCallback) {
+        return onPublishTimeoutCallback(timeoutContext);
+    }
+    return 1;
+}
+
+void LiveFanoutPublisher::pushVideoPacket(LiveVideoPacket *videoPacket) {
+    for (int i = 0; i < destinationCount; i++) {
+        LiveFanoutDestination *destination = destinations[i];
+        // 检查和入队在同一把锁里，停用这一路的线程拿到锁之后才会去销毁队列
+        pthread_mutex_lock(&destination->queueLock);
+        if (destination->active.load(std::memory_order_relaxed)) {
+            destination->packetPool->pushRecordingVideoPacketToQueue(videoPacket->clone());
+        }
+        pthread_mutex_unlock(&destination->queueLock);
+    }
+    delete videoPacket;
+}
+
+void LiveFanoutPublisher::pushAudioPacket(LiveAudioPacket *audioPacket) {
+    for (int i = 0; i < destinationCount; i++) {
+        LiveFanoutDestination *destination = destinations[i];
+        pthread_mutex_lock(&destination->queueLock);
+        // 这一路丢了视频就跟着丢掉等长的音频；输出卡住时 AAC 队列也有上限
+        if (destination->active.load(std::memory_order_relaxed)
+            && !destination->packetPool->discardAudioDebt(audioPacketDurationMills)
+            && destination->aacPacketPool->getAudioPacketQueueSize() < FANOUT_AUDIO_QUEUE_MAX_PACKETS) {
+            destination->aacPacketPool->pushAudioPacketToQueue(audioPacket->clone());
+        }
+        pthread_mutex_unlock(&destination->queueLock);
+    }
+    delete audioPacket;
+}
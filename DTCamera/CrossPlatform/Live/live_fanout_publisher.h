@@ -0,0 +1,122 @@
+//
+//  live_fanout_publisher.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_fanout_publisher_h
+#define live_fanout_publisher_h
+
+#include "platform_4_live_common.h"
+#include "live_packet_pool.h"
+#include "live_audio_packet_pool.h"
+#include "video_consumer_thread.h"
+#include "live_bitrate_controller.h"
+#include <pthread.h>
+#include <atomic>
+
+#define FANOUT_MAX_DESTINATIONS                                         8
+#define FANOUT_AUDIO_QUEUE_MAX_PACKETS                                  256  // 输出卡住时 AAC 队列的上限，约 5 秒
+
+class LiveFanoutPublisher;
+
+/** 一路输出：自己的视频队列、AAC 队列和发送线程，互不影响 **/
+typedef struct LiveFanoutDestination {
+    int index;
+    char *uri;
+    LivePacketPool *packetPool;
+    LiveAudioPacketPool *aacPacketPool;
+    VideoConsumerThread *consumer;
+    std::atomic<bool> active; // 正在接收数据：队列已经建好，没有连接失败也没有超时
+    pthread_mutex_t queueLock; // 推数据时检查 active 和入队、以及停用时销毁队列都要持有，入队不会阻塞
+    bool started; // 连接线程只由 start 创建和 join，只在 start 的线程里读写
+    int initCode;
+    pthread_t connectThread;
+    LiveFanoutPublisher *publisher;
+} LiveFanoutDestination;
+
+/**
+ * 编码器推进来的 AAC 包转给分发发布者，分到每一路输出自己的 AAC 队列
+ */
+class LiveFanoutAudioPacketPool: public LiveAudioPacketPool {
+public:
+    LiveFanoutAudioPacketPool(LiveFanoutPublisher *publisher);
+    virtual ~LiveFanoutAudioPacketPool();
+    
+    virtual void pushAudioPacketToQueue(LiveAudioPacket *audioPacket);
+    
+private:
+    LiveFanoutPublisher *publisher;
+};
+
+/**
+ * 把同一份编码好的 H.264 / AAC 包发到多路输出（主 RTMP、备 RTMP、本地 FLV / MP4 文件）
+ * 视频包共享编码数据，每一路有自己的队列预算和丢帧策略，慢的输出只会在自己的队列里丢帧，不会拖住其他输出
+ * 第一个加入的输出是主输出，主输出超时才会通知上层
+ */
+class LiveFanoutPublisher {
+public:
+    LiveFanoutPublisher();
+    ~LiveFanoutPublisher();
+    
+    /* start 之前调用，返回输出的下标，超过 FANOUT_MAX_DESTINATIONS 返回 -1 */
+    int addDestination(const char *uri);
+    int getDestinationCount();
+    LivePacketPool* getPacketPool(int index);
+    /* 编码线程把 AAC 包推到这里 */
+    LiveAudioPacketPool* getAudioPacketPool();
+    
+    /* 并行连接所有输出，返回连接成功的输出个数；主输出连接失败时返回主输出的错误码 */
+    int start(int videoWidth, int videoHeight, int videoFrameRate, int videoBitRate,
+              int audioSampleRate, int audioChannels, int audioBitRate, const char *audioCodecName);
+    /* 可以在任意线程调用，和正在进行的 start 并发时打断连接，连接线程留给 start 去 join */
+    void stop();
+    
+    void registerPublishTimeoutCallback(int (*on_publish_timeout_callback)(void *context), void *context);
+    /* start 之前调用，码率跟着主输出的拥塞情况调整，不接管 controller */
+    void setBitrateController(LiveBitrateController *controller);
+    /* start 之前调用，所有输出用同一种编码格式 */
+    void setVideoCodec(int videoCodec);
+    
+    /* 接管 videoPacket，每一路输出拿到一个共享数据的浅拷贝 */
+    void pushVideoPacket(LiveVideoPacket *videoPacket);
+    /* 接管 audioPacket，每一路输出拿到一份拷贝 */
+    void pushAudioPacket(LiveAudioPacket *audioPacket);
+    
+    int onDestinationTimeout(LiveFanoutDestination *destination);
+    
+private:
+    static void* startConnectThread(void *ptr);
+    void connect(LiveFanoutDestination *destination);
+    /* 停止往这一路推数据，返回时没有线程还在往它的队列里推 */
+    void deactivate(LiveFanoutDestination *destination);
+    /* 停用这一路并销毁它的队列 */
+    void releaseQueues(LiveFanoutDestination *destination);
+    
+    LiveFanoutDestination *destinations[FANOUT_MAX_DESTINATIONS];
+    int destinationCount;
+    LiveFanoutAudioPacketPool *audioPacketPool;
+    
+    int videoWidth;
+    int videoHeight;
+    int videoFrameRate;
+    int videoBitRate;
+    int videoCodec;
+    int audioSampleRate;
+    int audioChannels;
+    int audioBitRate;
+    char *audioCodecName;
+    int audioPacketDurationMills;
+    
+    bool isStarted;
+    bool isStopping;
+    pthread_mutex_t stateLock;
+    
+    int (*onPublishTimeoutCallback)(void *context);
+    void *timeoutContext;
+    LiveBitrateController *bitrateController;
+};
+
+#endif /* live_fanout_publisher_h */
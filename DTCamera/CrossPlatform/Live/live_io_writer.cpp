@@ -0,0 +1,213 @@
+//
+//  live_io_writer.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_io_writer.h"
+
+static int write_mux_packet(void *opaque, uint8_t *buf, int buf_size) {
+    LiveIOWriter *writer = (LiveIOWriter *)opaque;
+    return writer->write(buf, buf_size);
+}
+
+LiveIOWriter::LiveIOWriter(AVIOContext *networkContext, int capacity, int writeTimeoutMills) {
+    this->networkContext = networkContext;
+    mCapacity = capacity;
+    mWriteTimeoutMills = writeTimeoutMills;
+    mBytes = new uint8_t[capacity];
+    mReadIndex = 0;
+    mWriteIndex = 0;
+    mStopRequest = false;
+    mDrainDeadlineMills = -1;
+    pthread_mutex_init(&mQueueLock, NULL);
+    platform_4_live::initMonotonicCondition(&mNotEmpty);
+    platform_4_live::initMonotonicCondition(&mNotFull);
+    mError.store(0);
+    bytesQueued.store(0);
+    bytesSent.store(0);
+    writeStartMills.store(-1);
+    stallCount.store(0);
+    totalStallMills.store(0);
+    maxStallMills.store(0);
+    sendRateKbps.store(0);
+    rateWindowStartMills = platform_4_live::getMonotonicTimeMills();
+    rateWindowBytes = 0;
+    uint8_t *muxBuffer = (uint8_t *)av_malloc(IO_WRITER_MUX_BUFFER_SIZE);
+    muxContext = avio_alloc_context(muxBuffer, IO_WRITER_MUX_BUFFER_SIZE, 1, this, NULL, write_mux_packet, NULL);
+    muxContext->seekable = 0;
+}
+
+LiveIOWriter::~LiveIOWriter() {
+    if (NULL != muxContext) {
+        av_freep(&muxContext->buffer);
+        av_freep(&muxContext);
+    }
+    delete[] mBytes;
+    pthread_mutex_destroy(&mQueueLock);
+    pthread_cond_destroy(&mNotEmpty);
+    pthread_cond_destroy(&mNotFull);
+}
+
+AVIOContext* LiveIOWriter::getMuxContext() {
+    return muxContext;
+}
+
+int LiveIOWriter::getError() {
+    return mError.load();
+}
+
+/* muxer 线程：放进字节队列，满了就等 I/O 线程腾出空间 */
+int LiveIOWriter::write(uint8_t *buf, int size) {
+    int written = 0;
+    int64_t deadline = -1;
+    pthread_mutex_lock(&mQueueLock);
+    while (written < size) {
+        if (mError.load() < 0) {
+            break;
+        }
+        if (mStopRequest) {
+            mError.store(AVERROR_EXIT);
+            break;
+        }
+        int free = mCapacity - (int)(mWriteIndex - mReadIndex);
+        if (free <= 0) {
+            // 从第一次等空间开始计时，网络写一直卡住时 I/O 线程的超时回调会先报错，这里兜底
+            if (deadline < 0) {
+                deadline = platform_4_live::getDeadlineMills(mWriteTimeoutMills);
+            }
+            if (ETIMEDOUT == platform_4_live::waitConditionUntil(&mNotFull, &mQueueLock, deadline)) {
+                printf("LiveIOWriter wait for queue space time out after %d ms\n", mWriteTimeoutMills);
+                mError.store(AVERROR(ETIMEDOUT));
+            }
+            continue;
+        }
+        int length = MIN(free, size - written);
+        int offset = (int)(mWriteIndex % mCapacity);
+        int firstPart = MIN(length, mCapacity - offset);
+        memcpy(mBytes + offset, buf + written, firstPart);
+        if (firstPart < length) {
+            memcpy(mBytes, buf + written + firstPart, length - firstPart);
+        }
+        mWriteIndex += length;
+        written += length;
+        pthread_cond_signal(&mNotEmpty);
+    }
+    pthread_mutex_unlock(&mQueueLock);
+    bytesQueued += written;
+    if (written < size) {
+        return mError.load();
+    }
+    return size;
+}
+
+/* I/O 线程：取出一块数据，队列空时最多等 IO_WRITER_WAIT_MILLS，返回 < 0 表示可以退出了 */
+int LiveIOWriter::takeChunk(uint8_t *chunk) {
+    int ret = 0;
+    pthread_mutex_lock(&mQueueLock);
+    int64_t deadline = platform_4_live::getDeadlineMills(IO_WRITER_WAIT_MILLS);
+    while (mWriteIndex == mReadIndex && !mStopRequest) {
+        if (ETIMEDOUT == platform_4_live::waitConditionUntil(&mNotEmpty, &mQueueLock, deadline)) {
+            break;
+        }
+    }
+    int queued = (int)(mWriteIndex - mReadIndex);
+    bool drainExpired = mDrainDeadlineMills >= 0 && platform_4_live::getMonotonicTimeMills() >= mDrainDeadlineMills;
+    if (mStopRequest && (0 == queued || drainExpired || mError.load() < 0)) {
+        ret = -1;
+    } else if (queued > 0) {
+        ret = MIN(queued, IO_WRITER_CHUNK_SIZE);
+        int offset = (int)(mReadIndex % mCapacity);
+        int firstPart = MIN(ret, mCapacity - offset);
+        memcpy(chunk, mBytes + offset, firstPart);
+        if (firstPart < ret) {
+            memcpy(chunk + firstPart, mBytes, ret - firstPart);
+        }
+        mReadIndex += ret;
+        pthread_cond_signal(&mNotFull);
+    }
+    pthread_mutex_unlock(&mQueueLock);
+    return ret;
+}
+
+void LiveIOWriter::updateSendRate(int64_t now) {
+    int64_t elapsed = now - rateWindowStartMills;
+    if (elapsed >= IO_WRITER_RATE_WINDOW_MILLS) {
+        sendRateKbps.store((int)(rateWindowBytes * 8 / elapsed));
+        rateWindowStartMills = now;
+        rateWindowBytes = 0;
+    }
+}
+
+void LiveIOWriter::handleRun(void *ptr) {
+    uint8_t *chunk = new uint8_t[IO_WRITER_CHUNK_SIZE];
+    for (;;) {
+        int size = takeChunk(chunk);
+        if (size < 0) {
+            break;
+        }
+        if (size > 0 && mError.load() >= 0) {
+            int64_t start = platform_4_live::getMonotonicTimeMills();
+            writeStartMills.store(start);
+            avio_write(networkContext, chunk, size);
+            avio_flush(networkContext);
+            int64_t end = platform_4_live::getMonotonicTimeMills();
+            writeStartMills.store(-1);
+            int writeMills = (int)(end - start);
+            if (writeMills >= IO_WRITER_STALL_THRESHOLD_MILLS) {
+                stallCount++;
+                totalStallMills += writeMills;
+                if (writeMills > maxStallMills.load()) {
+                    maxStallMills.store(writeMills);
+                }
+            }
+            if (networkContext->error < 0) {
+                printf("LiveIOWriter network write error %d\n", networkContext->error);
+                pthread_mutex_lock(&mQueueLock);
+                mError.store(networkContext->error);
+                // 叫醒可能在等空间的 muxer，让它拿到错误
+                pthread_cond_broadcast(&mNotFull);
+                pthread_mutex_unlock(&mQueueLock);
+            } else {
+                bytesSent += size;
+                rateWindowBytes += size;
+            }
+        }
+        updateSendRate(platform_4_live::getMonotonicTimeMills());
+    }
+    delete[] chunk;
+}
+
+void LiveIOWriter::stop(int drainTimeoutMills) {
+    pthread_mutex_lock(&mQueueLock);
+    mStopRequest = true;
+    mDrainDeadlineMills = platform_4_live::getDeadlineMills(drainTimeoutMills);
+    pthread_cond_broadcast(&mNotEmpty);
+    pthread_cond_broadcast(&mNotFull);
+    pthread_mutex_unlock(&mQueueLock);
+    wait();
+}
+
+void LiveIOWriter::stop() {
+    stop(0);
+}
+
+int LiveIOWriter::getCurrentStallMills() {
+    int64_t start = writeStartMills.load();
+    return start >= 0 ? (int)(platform_4_live::getMonotonicTimeMills() - start) : 0;
+}
+
+void LiveIOWriter::getStats(LiveIOWriterStats *stats) {
+    stats->bytesQueued = bytesQueued.load();
+    stats->bytesSent = bytesSent.load();
+    pthread_mutex_lock(&mQueueLock);
+    stats->queuedBytes = (int)(mWriteIndex - mReadIndex);
+    pthread_mutex_unlock(&mQueueLock);
+    stats->sendRateKbps = sendRateKbps.load();
+    stats->currentStallMills = getCurrentStallMills();
+    stats->stallCount = stallCount.load();
+    stats->totalStallMills = totalStallMills.load();
+    stats->maxStallMills = maxStallMills.load();
+}
@@ -0,0 +1,94 @@
+//
+//  live_io_writer.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_io_writer_h
+#define live_io_writer_h
+
+#include "platform_4_live_common.h"
+#include "platform_4_live_ffmpeg.h"
+#include "live_thread.h"
+#include <atomic>
+
+#define IO_WRITER_QUEUE_CAPACITY                                        (1024 * 1024)  // 4Mbps 下约 2 秒
+#define IO_WRITER_MUX_BUFFER_SIZE                                       (32 * 1024)
+#define IO_WRITER_CHUNK_SIZE                                            (32 * 1024)
+#define IO_WRITER_WAIT_MILLS                                            100
+#define IO_WRITER_RATE_WINDOW_MILLS                                     1000
+#define IO_WRITER_STALL_THRESHOLD_MILLS                                 50  // 一次写超过这个时间算一次卡顿
+
+typedef struct LiveIOWriterStats {
+    int64_t bytesQueued;
+    int64_t bytesSent;
+    int queuedBytes;
+    int sendRateKbps;        // 最近一个统计窗口的实际上行速率
+    int currentStallMills;   // 正在进行的这次写已经阻塞的时间
+    int64_t stallCount;
+    int64_t totalStallMills;
+    int maxStallMills;
+} LiveIOWriterStats;
+
+/**
+ * 把封装和网络发送拆开：muxer 写进自定义的 AVIOContext，数据进入有界的字节队列，
+ * 由单独的 I/O 线程写到真正的网络 AVIOContext 上，同时统计实际发送速率和写阻塞的时间
+ * 字节队列满了 muxer 才会阻塞，最多阻塞 writeTimeoutMills，网络出错或者超时后 muxer 的下一次写会返回错误
+ * 自定义的 AVIOContext 不能 seek，只用在网络输出上，本地文件要回写头（mp4 的 moov、flv 的时长）不经过这里
+ */
+class LiveIOWriter: public LiveThread {
+public:
+    /* writeTimeoutMills < 0 时 muxer 一直等到有空间为止 */
+    LiveIOWriter(AVIOContext *networkContext, int capacity, int writeTimeoutMills);
+    virtual ~LiveIOWriter();
+    
+    /* 给 AVFormatContext::pb 用的 AVIOContext，由 LiveIOWriter 负责释放 */
+    AVIOContext* getMuxContext();
+    
+    /* 把队列里剩下的数据最多再发 drainTimeoutMills 毫秒，然后停掉 I/O 线程 */
+    void stop(int drainTimeoutMills);
+    virtual void stop();
+    
+    void getStats(LiveIOWriterStats *stats);
+    /* 不加锁，网络层的中断回调里用 */
+    int getCurrentStallMills();
+    int getError();
+    
+    int write(uint8_t *buf, int size);
+    
+protected:
+    virtual void handleRun(void *ptr);
+    
+private:
+    int takeChunk(uint8_t *chunk);
+    void updateSendRate(int64_t now);
+    
+    AVIOContext *networkContext;
+    AVIOContext *muxContext;
+    
+    uint8_t *mBytes;
+    int mCapacity;
+    int mWriteTimeoutMills;
+    int64_t mReadIndex;
+    int64_t mWriteIndex;
+    bool mStopRequest;
+    int64_t mDrainDeadlineMills;
+    pthread_mutex_t mQueueLock;
+    pthread_cond_t mNotEmpty;
+    pthread_cond_t mNotFull;
+    
+    std::atomic<int> mError;
+    std::atomic<int64_t> bytesQueued;
+    std::atomic<int64_t> bytesSent;
+    std::atomic<int64_t> writeStartMills; // 正在进行的写开始的时间，没有在写时为 -1
+    std::atomic<int64_t> stallCount;
+    std::atomic<int64_t> totalStallMills;
+    std::atomic<int> maxStallMills;
+    std::atomic<int> sendRateKbps;
+    int64_t rateWindowStartMills;
+    int64_t rateWindowBytes;
+};
+
+#endif /* live_io_writer_h */
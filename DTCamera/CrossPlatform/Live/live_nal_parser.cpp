@@ -0,0 +1,257 @@
+//
+//  live_nal_parser.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_nal_parser.h"
+#include <string.h>
+
+// 定义 LIVE_NAL_PARSER_NO_SIMD 时所有平台都走 8 字节的标量路径，Bench 里用来对比
+#if defined(__aarch64__) && !defined(LIVE_NAL_PARSER_NO_SIMD)
+#define LIVE_NAL_PARSER_NEON                                            1
+#include <arm_neon.h>
+#elif defined(__SSE2__) && !defined(LIVE_NAL_PARSER_NO_SIMD)
+#define LIVE_NAL_PARSER_SSE2                                            1
+#include <emmintrin.h>
+#endif
+
+int LiveNALParser::findZeroPair(const uint8_t *data, int size, int offset) {
+    int i = offset;
+#if defined(LIVE_NAL_PARSER_NEON)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    // 每次读 17 个字节，错开一个字节读两次，两个比较结果相与就是 00 00 的位置
+    while (i + 17 <= size) {
+        uint8x16_t first = vceqq_u8(vld1q_u8(data + i), zero);
+        uint8x16_t second = vceqq_u8(vld1q_u8(data + i + 1), zero);
+        uint8x16_t pair = vandq_u8(first, second);
+        // 每个字节压成 4 位，16 个字节的结果放进一个 64 位整数
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(pair), 4)), 0);
+        if (0 != mask) {
+            return i + (__builtin_ctzll(mask) >> 2);
+        }
+        i += 16;
+    }
+#elif defined(LIVE_NAL_PARSER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 17 <= size) {
+        __m128i first = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), zero);
+        __m128i second = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 1)), zero);
+        int mask = _mm_movemask_epi8(_mm_and_si128(first, second));
+        if (0 != mask) {
+            return i + __builtin_ctz(mask);
+        }
+        i += 16;
+    }
+#else
+    // 8 个字节里一个 00 都没有时，00 00 也不可能从这 8 个字节里开始
+    while (i + 8 <= size) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        if (0 == ((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL)) {
+            i += 8;
+            continue;
+        }
+        for (int j = i; j < i + 8 && j + 1 < size; j++) {
+            if (data[j] == 0x00 && data[j + 1] == 0x00) {
+                return j;
+            }
+        }
+        i += 8;
+    }
+#endif
+    for (; i + 1 < size; i++) {
+        if (data[i] == 0x00 && data[i + 1] == 0x00) {
+            return i;
+        }
+    }
+    return size;
+}
+
+int LiveNALParser::findStartCode(const uint8_t *data, int size, int offset, int *startCodeSize) {
+    int position = findZeroPair(data, size, offset);
+    while (position + 2 < size) {
+        if (data[position + 2] == 0x01) {
+            if (position > offset && data[position - 1] == 0x00) {
+                *startCodeSize = 4;
+                return position - 1;
+            }
+            *startCodeSize = 3;
+            return position;
+        }
+        // 00 00 后面不是 01，连续的 00 里下一对从后一个字节开始
+        position = findZeroPair(data, size, position + 1);
+    }
+    return -1;
+}
+
+int LiveNALParser::unescapeRBSP(const uint8_t *src, int size, uint8_t *dst) {
+    int length = 0;
+    int i = 0;
+    while (i < size) {
+        int position = findZeroPair(src, size, i);
+        if (position + 2 >= size) {
+            memcpy(dst + length, src + i, size - i);
+            length += size - i;
+            break;
+        }
+        // 00 00 之前的数据整段拷贝，00 00 03 的 03 跳过，否则下一对可能从第二个 00 开始
+        int copySize = src[position + 2] == 0x03 ? position + 2 - i : position + 1 - i;
+        memcpy(dst + length, src + i, copySize);
+        length += copySize;
+        i += copySize;
+        if (src[position + 2] == 0x03) {
+            i++;
+        }
+    }
+    return length;
+}
+
+bool LiveNALParser::isAVCC(const uint8_t *data, int size) {
+    if (NULL == data || size <= LIVE_NAL_LENGTH_SIZE) {
+        return false;
+    }
+    // 长度为 1 的 NAL 没有意义，00 00 00 01 开头的一定是起始码
+    if (data[0] == 0x00 && data[1] == 0x00 && data[2] == 0x00 && data[3] == 0x01) {
+        return false;
+    }
+    int offset = 0;
+    while (offset + LIVE_NAL_LENGTH_SIZE <= size) {
+        uint32_t naluSize = ((uint32_t)data[offset] << 24) | ((uint32_t)data[offset + 1] << 16) |
+                            ((uint32_t)data[offset + 2] << 8) | (uint32_t)data[offset + 3];
+        if (naluSize == 0 || naluSize > (uint32_t)(size - offset - LIVE_NAL_LENGTH_SIZE)) {
+            return false;
+        }
+        offset += LIVE_NAL_LENGTH_SIZE + naluSize;
+    }
+    return offset == size;
+}
+
+int LiveNALParser::splitAnnexB(const uint8_t *data, int size, LiveNALUnit *units, int maxUnits) {
+    int count = 0;
+    int startCodeSize = 0;
+    // 第一个起始码之前的数据不属于任何 NAL，丢掉
+    int position = findStartCode(data, size, 0, &startCodeSize);
+    while (position >= 0) {
+        int start = position + startCodeSize;
+        int nextStartCodeSize = 0;
+        int next = findStartCode(data, size, start, &nextStartCodeSize);
+        int end = next >= 0 ? next : size;
+        // 去掉 trailing_zero_8bits
+        while (end > start && data[end - 1] == 0x00) {
+            end--;
+        }
+        if (end > start) {
+            if (count >= maxUnits) {
+                return -1;
+            }
+            units[count].offset = start;
+            units[count].size = end - start;
+            units[count].startCodeSize = startCodeSize;
+            count++;
+        }
+        position = next;
+        startCodeSize = nextStartCodeSize;
+    }
+    return count;
+}
+
+int LiveNALParser::split(const uint8_t *data, int size, LiveNALUnit *units, int maxUnits) {
+    if (!isAVCC(data, size)) {
+        return splitAnnexB(data, size, units, maxUnits);
+    }
+    int count = 0;
+    int offset = 0;
+    while (offset < size) {
+        if (count >= maxUnits) {
+            return -1;
+        }
+        int naluSize = (data[offset] << 24) | (data[offset + 1] << 16) | (data[offset + 2] << 8) | data[offset + 3];
+        units[count].offset = offset + LIVE_NAL_LENGTH_SIZE;
+        units[count].size = naluSize;
+        units[count].startCodeSize = LIVE_NAL_LENGTH_SIZE;
+        count++;
+        offset += LIVE_NAL_LENGTH_SIZE + naluSize;
+    }
+    return count;
+}
+
+bool LiveNALParser::canConvertInPlace(LiveNALUnit *units, int count) {
+    for (int i = 0; i < count; i++) {
+        if (units[i].startCodeSize < LIVE_NAL_LENGTH_SIZE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int LiveNALParser::getAVCCSize(LiveNALUnit *units, int count) {
+    int size = 0;
+    for (int i = 0; i < count; i++) {
+        size += LIVE_NAL_LENGTH_SIZE + units[i].size;
+    }
+    return size;
+}
+
+int LiveNALParser::writeAVCC(const uint8_t *src, LiveNALUnit *units, int count, uint8_t *dst) {
+    // 原地转换时写的位置永远不超过读的位置，从前往后写不会覆盖还没读的数据
+    int offset = 0;
+    for (int i = 0; i < count; i++) {
+        int naluSize = units[i].size;
+        dst[offset] = (naluSize >> 24) & 0xff;
+        dst[offset + 1] = (naluSize >> 16) & 0xff;
+        dst[offset + 2] = (naluSize >> 8) & 0xff;
+        dst[offset + 3] = naluSize & 0xff;
+        offset += LIVE_NAL_LENGTH_SIZE;
+        if (dst + offset != src + units[i].offset) {
+            memmove(dst + offset, src + units[i].offset, naluSize);
+        }
+        offset += naluSize;
+    }
+    return offset;
+}
+
+int LiveNALParser::getNALUType(const uint8_t *nalu, int codec) {
+    if (LIVE_VIDEO_CODEC_HEVC == codec) {
+        return (nalu[0] >> 1) & 0x3F;
+    }
+    return nalu[0] & 0x1F;
+}
+
+bool LiveNALParser::isVCL(int naluType, int codec) {
+    if (LIVE_VIDEO_CODEC_HEVC == codec) {
+        return naluType < HEVC_NALU_TYPE_VPS;
+    }
+    return naluType >= H264_NALU_TYPE_NON_IDR_PICTURE && naluType <= H264_NALU_TYPE_IDR_PICTURE;
+}
+
+bool LiveNALParser::isParameterSet(int naluType, int codec) {
+    if (LIVE_VIDEO_CODEC_HEVC == codec) {
+        return naluType >= HEVC_NALU_TYPE_VPS && naluType <= HEVC_NALU_TYPE_PPS;
+    }
+    return naluType == H264_NALU_TYPE_SEQUENCE_PARAMETER_SET || naluType == H264_NALU_TYPE_PICTURE_PARAMETER_SET;
+}
+
+int LiveNALParser::findPrimaryNAL(const uint8_t *data, int size, int codec) {
+    if (NULL == data || size <= 0) {
+        return -1;
+    }
+    LiveNALUnit units[LIVE_NAL_MAX_UNITS];
+    int count = split(data, size, units, LIVE_NAL_MAX_UNITS);
+    if (count <= 0) {
+        return -1;
+    }
+    int parameterSet = -1;
+    for (int i = 0; i < count; i++) {
+        int naluType = getNALUType(data + units[i].offset, codec);
+        if (isVCL(naluType, codec)) {
+            return units[i].offset;
+        }
+        if (parameterSet < 0 && isParameterSet(naluType, codec)) {
+            parameterSet = units[i].offset;
+        }
+    }
+    return parameterSet >= 0 ? parameterSet : units[0].offset;
+}
@@ -0,0 +1,87 @@
+//
+//  live_nal_parser.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_nal_parser_h
+#define live_nal_parser_h
+
+#include "platform_4_live_common.h"
+
+#define H264_NALU_TYPE_NON_IDR_PICTURE                                  1
+#define H264_NALU_TYPE_IDR_PICTURE                                      5
+#define H264_NALU_TYPE_SEQUENCE_PARAMETER_SET                           7
+#define H264_NALU_TYPE_PICTURE_PARAMETER_SET                            8
+#define H264_NALU_TYPE_SEI                                              6
+
+#define HEVC_NALU_TYPE_BLA_W_LP                                         16  // 16 ~ 23 是 IRAP（BLA / IDR / CRA）
+#define HEVC_NALU_TYPE_IDR_W_RADL                                       19
+#define HEVC_NALU_TYPE_RSV_IRAP_VCL23                                   23
+#define HEVC_NALU_TYPE_VPS                                              32
+#define HEVC_NALU_TYPE_SPS                                              33
+#define HEVC_NALU_TYPE_PPS                                              34
+#define HEVC_NALU_TYPE_PREFIX_SEI                                       39
+#define HEVC_NALU_TYPE_SUFFIX_SEI                                       40
+
+#define LIVE_VIDEO_CODEC_H264                                           0
+#define LIVE_VIDEO_CODEC_HEVC                                           1
+
+#define LIVE_NAL_LENGTH_SIZE                                            4
+#define LIVE_NAL_MAX_UNITS                                              128 // 一个访问单元里最多的 NAL 个数
+
+/** 包里的一个 NAL，offset 指向 NAL 头，不含起始码 / 长度前缀，也不含结尾的补零 **/
+typedef struct LiveNALUnit {
+    int offset;
+    int size;
+    int startCodeSize; // 3 或 4，长度前缀格式的固定为 4
+} LiveNALUnit;
+
+/**
+ * NAL 的切分和格式转换，只处理字节，不分配内存
+ * 起始码格式（Annex B）一个访问单元里可以有多个 NAL，起始码 3 / 4 字节混用，一次扫描切出所有 NAL
+ * 长度前缀格式（AVCC / hvcC）固定 4 字节大端长度
+ */
+class LiveNALParser {
+public:
+    /*
+     * 从 offset 开始找第一对连续的 00，返回第一个 00 的位置，没有返回 size
+     * 起始码和防竞争字节都以 00 00 开头，压缩数据里连续两个 00 很少见，整段跳过不含 00 00 的数据
+     * ARM64 用 NEON、x86 用 SSE2 一次比较 16 字节，其他平台一次比较 8 字节
+     */
+    static int findZeroPair(const uint8_t *data, int size, int offset);
+
+    /* 从 offset 开始找下一个起始码，返回起始码第一个字节的位置，没有返回 -1 */
+    static int findStartCode(const uint8_t *data, int size, int offset, int *startCodeSize);
+
+    /* 4 字节长度前缀正好把整个包切完才认为是长度前缀格式 */
+    static bool isAVCC(const uint8_t *data, int size);
+
+    /* 切分起始码格式的包，返回 NAL 个数，超过 maxUnits 返回 -1 */
+    static int splitAnnexB(const uint8_t *data, int size, LiveNALUnit *units, int maxUnits);
+    /* 两种格式都能切，先按长度前缀试 */
+    static int split(const uint8_t *data, int size, LiveNALUnit *units, int maxUnits);
+
+    /* 所有起始码都是 4 字节时长度前缀格式不会比原来长，可以原地转换 */
+    static bool canConvertInPlace(LiveNALUnit *units, int count);
+    static int getAVCCSize(LiveNALUnit *units, int count);
+    /* 按 units 把 src 写成长度前缀格式，dst 可以等于 src（要求 canConvertInPlace），返回写出的字节数 */
+    static int writeAVCC(const uint8_t *src, LiveNALUnit *units, int count, uint8_t *dst);
+
+    /* 去掉防竞争字节 00 00 03 里的 03，返回 RBSP 的长度，dst 至少 size 字节 */
+    static int unescapeRBSP(const uint8_t *src, int size, uint8_t *dst);
+
+    static int getNALUType(const uint8_t *nalu, int codec);
+    static bool isVCL(int naluType, int codec);
+    static bool isParameterSet(int naluType, int codec);
+
+    /*
+     * 代表整个访问单元的 NAL 的偏移：有图像数据时取第一个 slice，否则取第一个参数集，都没有取第一个 NAL
+     * 这样 SEI + IDR 拼在一起的包按 IDR 处理，SPS + PPS 的包按参数集处理，找不到返回 -1
+     */
+    static int findPrimaryNAL(const uint8_t *data, int size, int codec);
+};
+
+#endif /* live_nal_parser_h */
@@ -0,0 +1,48 @@
+//
+//  live_packet_notifier.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_packet_notifier.h"
+
+LivePacketNotifier::LivePacketNotifier() {
+    mSequence.store(0);
+    mWaiters.store(0);
+    pthread_mutex_init(&mLock, NULL);
+    platform_4_live::initMonotonicCondition(&mCondition);
+}
+
+LivePacketNotifier::~LivePacketNotifier() {
+    pthread_mutex_destroy(&mLock);
+    pthread_cond_destroy(&mCondition);
+}
+
+void LivePacketNotifier::notify() {
+    mSequence.fetch_add(1);
+    // 和 waitUntil 里 mWaiters++ 之后重新检查序号配对
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWaiters.load(std::memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&mLock);
+        pthread_cond_broadcast(&mCondition);
+        pthread_mutex_unlock(&mLock);
+    }
+}
+
+int64_t LivePacketNotifier::getSequence() {
+    return mSequence.load(std::memory_order_acquire);
+}
+
+int LivePacketNotifier::waitUntil(int64_t sequence, int64_t deadlineMills) {
+    int ret = 0;
+    pthread_mutex_lock(&mLock);
+    mWaiters.fetch_add(1);
+    while (mSequence.load() == sequence && ETIMEDOUT != ret) {
+        ret = platform_4_live::waitConditionUntil(&mCondition, &mLock, deadlineMills);
+    }
+    mWaiters.fetch_sub(1);
+    pthread_mutex_unlock(&mLock);
+    return ret;
+}
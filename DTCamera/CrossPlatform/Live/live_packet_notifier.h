@@ -0,0 +1,41 @@
+//
+//  live_packet_notifier.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_packet_notifier_h
+#define live_packet_notifier_h
+
+#include "platform_4_live_common.h"
+#include <pthread.h>
+#include <atomic>
+
+/**
+ * 多个队列共用的到达通知，让发送线程同时等音频和视频两个队列
+ * 队列每放进一个包（或者 abort）序号加一；消费者先记下序号，检查完所有队列都没有数据再拿这个序号去等，不会丢唤醒
+ * 没有消费者挂起时 notify 不加锁
+ */
+class LivePacketNotifier {
+public:
+    LivePacketNotifier();
+    ~LivePacketNotifier();
+
+    /* 生产者：队列里有了新包或者被 abort */
+    void notify();
+
+    /* 消费者：检查队列之前先取序号 */
+    int64_t getSequence();
+    /* 序号不再是 sequence 或者到了单调时钟的 deadlineMills 才返回，超时返回 ETIMEDOUT */
+    int waitUntil(int64_t sequence, int64_t deadlineMills);
+
+private:
+    std::atomic<int64_t> mSequence;
+    std::atomic<int> mWaiters;
+    pthread_mutex_t mLock;
+    pthread_cond_t mCondition;
+};
+
+#endif /* live_packet_notifier_h */
@@ -9,114 +9,195 @@
 #include "live_packet_pool.h"
 
 LivePacketPool::LivePacketPool() {
-    audioPacketQueue = NULL;
+    audioSampleRing = NULL;
+    audioDriftCompensator = NULL;
+    audioJitterBuffer = NULL;
+    audioJitterConfig.targetDepthMills = AUDIO_JITTER_TARGET_DEPTH_MILLS;
+    audioJitterConfig.minDepthMills = AUDIO_JITTER_MIN_DEPTH_MILLS;
+    audioJitterConfig.maxDepthMills = AUDIO_JITTER_MAX_DEPTH_MILLS;
     recordingVideoPacketQueue = NULL;
-    buffer = NULL;
-    pthread_rwlock_init(&mRwlock, NULL);
+    videoBufferPool = new LiveBufferPool("video packet buffer pool");
+    videoCodec = LIVE_VIDEO_CODEC_H264;
+    videoQueueBudget.maxBytes = VIDEO_PACKET_QUEUE_MAX_BYTES;
+    videoQueueBudget.maxDurationMills = VIDEO_PACKET_QUEUE_MAX_DURATION_MILLS;
+    videoQueueBudget.highWatermarkPercent = VIDEO_PACKET_QUEUE_HIGH_WATERMARK_PERCENT;
+    videoQueueBudget.lowWatermarkPercent = VIDEO_PACKET_QUEUE_LOW_WATERMARK_PERCENT;
+    videoQueueWatermarkLevel = VIDEO_QUEUE_WATERMARK_NORMAL;
+    onVideoQueueWatermarkCallback = NULL;
+    watermarkContext = NULL;
+    stagedVideoBytes.store(0);
+    stagedVideoDurationMills.store(0);
 }
 
 LivePacketPool::~LivePacketPool() {
-    pthread_rwlock_destroy(&mRwlock);
-}
-
-LivePacketPool* LivePacketPool::instance = new LivePacketPool();
-LivePacketPool* LivePacketPool::GetInstance() {
-    return instance;
+    // 外面还有共享编码数据的包时，池子等它们都释放了再销毁
+    videoBufferPool->release();
 }
 
 void LivePacketPool::initAudioPacketQueue(int audioSampleRate) {
-    const char *name = "audioPacket pcm data queue";
-    audioPacketQueue = new LiveAudioPacketQueue(name);
+    const char *name = "audioPacket pcm data ring";
     this->audioSampleRate = audioSampleRate;
     this->channels = 2;
     bufferSize = audioSampleRate * channels * AUDIO_PACKET_DURATION_IN_SECS;
-    buffer = new short[bufferSize];
-    bufferCursor = 0;
+    audioSampleRing = new LivePCMRingBuffer(name, audioSampleRate * channels * AUDIO_PCM_RING_DURATION_IN_SECS, audioSampleRate, channels);
+    audioDriftCompensator = new LiveAudioDriftCompensator(audioSampleRate, channels);
+    audioJitterBuffer = new LiveAudioJitterBuffer(audioSampleRing, audioSampleRate, channels, audioJitterConfig);
 }
 
 void LivePacketPool::abortAudioPacketQueue() {
-    if (NULL != audioPacketQueue) {
-        audioPacketQueue->abort();
+    if (NULL != audioSampleRing) {
+        audioSampleRing->abort();
+    }
+    if (NULL != audioJitterBuffer) {
+        audioJitterBuffer->abort();
     }
 }
 
 void LivePacketPool::destroyAudioPacketQueue() {
-    if (NULL != audioPacketQueue) {
-        delete audioPacketQueue;
-        audioPacketQueue = NULL;
+    if (NULL != audioJitterBuffer) {
+        delete audioJitterBuffer;
+        audioJitterBuffer = NULL;
     }
-    if (buffer) {
-        delete[] buffer;
-        buffer = NULL;
+    if (NULL != audioSampleRing) {
+        delete audioSampleRing;
+        audioSampleRing = NULL;
+    }
+    if (NULL != audioDriftCompensator) {
+        delete audioDriftCompensator;
+        audioDriftCompensator = NULL;
     }
 }
 
-int LivePacketPool::getAudioPacket(LiveAudioPacket **audioPacket, bool block) {
+int LivePacketPool::getAudioSamples(short *samples, int sampleSize, double *timeMills, bool block) {
     int result = -1;
-    if (NULL != audioPacketQueue) {
-        result = audioPacketQueue->get(audioPacket, block);
+    if (block && NULL != audioJitterBuffer) {
+        // 编码线程按节拍取，突发和迟到由抖动缓冲吸收
+        result = audioJitterBuffer->pull(samples, sampleSize, timeMills);
+    } else if (NULL != audioSampleRing) {
+        result = audioSampleRing->read(samples, sampleSize, timeMills, block);
     }
     return result;
 }
 
 int LivePacketPool::getAudioPacketQueueSize() {
-    return audioPacketQueue->size();
+    return audioSampleRing->size() / bufferSize;
 }
 
 bool LivePacketPool::discardAudioPacket() {
     bool ret = false;
-    LiveAudioPacket *tempAudioPacket = NULL;
-    int resultCode = audioPacketQueue->get(&tempAudioPacket, true);
-    if (resultCode > 0) {
-        delete tempAudioPacket;
-        tempAudioPacket = NULL;
-        pthread_rwlock_wrlock(&mRwlock);
-        totalDiscardVideoPacketDuration -= (AUDIO_PACKET_DURATION_IN_SECS * 1000.0f);
-        pthread_rwlock_unlock(&mRwlock);
+    if (NULL != audioSampleRing && audioSampleRing->discard(bufferSize) > 0) {
+        discardController.recordAudioDrop(AUDIO_PACKET_DURATION_IN_SECS * 1000.0f);
         ret = true;
     }
     return ret;
 }
 
 bool LivePacketPool::detectDiscardAudioPacket() {
+    return discardController.hasAudioDebt(AUDIO_PACKET_DURATION_IN_SECS * 1000.0f);
+}
+
+bool LivePacketPool::discardAudioDebt(int durationMills) {
     bool ret = false;
-    pthread_rwlock_wrlock(&mRwlock);
-    ret = totalDiscardVideoPacketDuration >= (AUDIO_PACKET_DURATION_IN_SECS * 1000.0f);
-    pthread_rwlock_unlock(&mRwlock);
+    if (discardController.hasAudioDebt(durationMills)) {
+        discardController.recordAudioDrop(durationMills);
+        ret = true;
+    }
     return ret;
 }
 
-void LivePacketPool::pushAudioPacketToQueue(LiveAudioPacket *audioPacket) {
-    if (NULL != audioPacketQueue) {
-        int audioPacketBufferCursor = 0;
-        while (audioPacket->size > 0) {
-            int audioBufferLength = bufferSize - bufferCursor;
-            int length = MIN(audioBufferLength, audioPacket->size);
-            memcpy(buffer + bufferCursor, audioPacket->buffer + audioPacketBufferCursor, length * sizeof(short));
-            audioPacket->size -= length;
-            bufferCursor += length;
-            audioPacketBufferCursor += length;
-            if (bufferCursor == bufferSize) {
-                LiveAudioPacket *targetAudioPacket = new LiveAudioPacket();
-                targetAudioPacket->size = bufferSize;
-                short *audioBuffer = new short[bufferSize];
-                memcpy(audioBuffer, buffer, bufferSize * sizeof(short));
-                targetAudioPacket->buffer = audioBuffer;
-                audioPacketQueue->put(targetAudioPacket);
-                bufferCursor = 0;
-            }
-        }
-        delete audioPacket;
+void LivePacketPool::getDiscardStats(LiveDiscardStats *stats) {
+    discardController.getStats(stats);
+}
+
+void LivePacketPool::pushAudioSamples(const short *samples, int sampleSize, double timeMills) {
+    if (NULL != audioSampleRing) {
+        audioSampleRing->write(samples, sampleSize, timeMills);
+    }
+}
+
+void LivePacketPool::pushAudioSilence(int sampleSize, double timeMills) {
+    if (NULL != audioSampleRing) {
+        audioSampleRing->writeSilence(sampleSize, timeMills);
+    }
+}
+
+void LivePacketPool::pushCapturedAudioSamples(const short *samples, int sampleSize, double captureTimeMills) {
+    if (NULL == audioSampleRing || NULL == audioDriftCompensator) {
+        return;
+    }
+    LiveAudioDriftOutput output;
+    audioDriftCompensator->process(samples, sampleSize, captureTimeMills, &output);
+    if (output.gapSampleSize > 0) {
+        audioSampleRing->writeSilence(output.gapSampleSize, output.gapTimeMills);
+    }
+    if (output.sampleSize > 0) {
+        audioSampleRing->write(output.samples, output.sampleSize, output.timeMills);
     }
 }
 
+void LivePacketPool::getAudioDriftStats(LiveAudioDriftStats *stats) {
+    memset(stats, 0, sizeof(LiveAudioDriftStats));
+    if (NULL != audioDriftCompensator) {
+        audioDriftCompensator->getStats(stats);
+    }
+    if (NULL != audioSampleRing) {
+        stats->overflowSamples = audioSampleRing->getOverflowSamples();
+    }
+}
+
+void LivePacketPool::setAudioJitterConfig(LiveAudioJitterConfig config) {
+    audioJitterConfig = config;
+}
+
+void LivePacketPool::getAudioJitterStats(LiveAudioJitterStats *stats) {
+    memset(stats, 0, sizeof(LiveAudioJitterStats));
+    if (NULL != audioJitterBuffer) {
+        audioJitterBuffer->getStats(stats);
+    }
+}
+
+void LivePacketPool::pushAudioPacketToQueue(LiveAudioPacket *audioPacket) {
+    pushAudioSamples(audioPacket->buffer, audioPacket->size, audioPacket->position);
+    delete audioPacket;
+}
+
+LiveVideoPacket* LivePacketPool::obtainVideoPacket(int size) {
+    LiveVideoPacket *videoPacket = new LiveVideoPacket();
+    videoPacket->payload = new LiveVideoPayload(videoBufferPool, size);
+    videoPacket->buffer = videoPacket->payload->data;
+    videoPacket->size = size;
+    videoPacket->codec = videoCodec;
+    return videoPacket;
+}
+
+void LivePacketPool::setVideoCodec(int videoCodec) {
+    this->videoCodec = videoCodec;
+}
+
+void LivePacketPool::getVideoBufferPoolStats(LiveBufferPoolStats *stats) {
+    videoBufferPool->getStats(stats);
+}
+
+void LivePacketPool::setVideoQueueBudget(LiveVideoQueueBudget budget) {
+    videoQueueBudget = budget;
+}
+
+void LivePacketPool::registerVideoQueueWatermarkCallback(on_video_queue_watermark_callback callback, void *context) {
+    this->onVideoQueueWatermarkCallback = callback;
+    this->watermarkContext = context;
+}
+
 void LivePacketPool::initRecordingVideoPacketQueue() {
     if (NULL == recordingVideoPacketQueue) {
         const char *name = "recording video yuv frame packet queue";
-        recordingVideoPacketQueue = new LiveVideoPacketQueue(name);
-        totalDiscardVideoPacketDuration = 0;
+        recordingVideoPacketQueue = new LiveVideoPacketQueue(name, VIDEO_PACKET_QUEUE_RING_CAPACITY);
+        discardController.reset();
+        videoQueueWatermarkLevel = VIDEO_QUEUE_WATERMARK_NORMAL;
+        videoDropPolicy.reset();
         tempVideoPacket = NULL;
         tempVideoPacketRefCnt = 0;
+        stagedVideoBytes.store(0);
+        stagedVideoDurationMills.store(0);
     }
 }
 
@@ -134,6 +215,15 @@ void LivePacketPool::destroyRecordingVideoPacketQueue() {
             delete tempVideoPacket;
             tempVideoPacket = NULL;
         }
+        videoBufferPool->dumpStats();
+        videoDropPolicy.dumpStats();
+        discardController.dumpStats();
+    }
+}
+
+void LivePacketPool::setRecordingVideoPacketNotifier(LivePacketNotifier *notifier) {
+    if (NULL != recordingVideoPacketQueue) {
+        recordingVideoPacketQueue->setNotifier(notifier);
     }
 }
 
@@ -145,26 +235,95 @@ int LivePacketPool::getRecordingVideoPacket(LiveVideoPacket **videoPacket, bool
     return result;
 }
 
+int LivePacketPool::getRecordingVideoPackets(LiveVideoPacket **videoPackets, int maxCount, int maxWaitMills) {
+    int result = -1;
+    if (NULL != recordingVideoPacketQueue) {
+        result = recordingVideoPacketQueue->getBatch(videoPackets, maxCount, maxWaitMills);
+    }
+    int64_t batchBytes = 0;
+    int batchDurationMills = 0;
+    for (int i = 0; i < result; i++) {
+        batchBytes += videoPackets[i]->size;
+        batchDurationMills += videoPackets[i]->duration;
+    }
+    if (result > 0) {
+        stagedVideoBytes += batchBytes;
+        stagedVideoDurationMills += batchDurationMills;
+    }
+    return result;
+}
+
+void LivePacketPool::releaseStagedVideoPacket(LiveVideoPacket *videoPacket) {
+    stagedVideoBytes -= videoPacket->size;
+    stagedVideoDurationMills -= videoPacket->duration;
+}
+
+/* 队列按字节数和时长计算的水位，取两者中较高的那个 */
+int LivePacketPool::getVideoQueueFillPercent() {
+    int fillPercent = 0;
+    if (videoQueueBudget.maxBytes > 0) {
+        fillPercent = MAX(fillPercent, (int)(getRecordingVideoPacketQueueBytes() * 100 / videoQueueBudget.maxBytes));
+    }
+    if (videoQueueBudget.maxDurationMills > 0) {
+        fillPercent = MAX(fillPercent, getRecordingVideoPacketQueueDurationMills() * 100 / videoQueueBudget.maxDurationMills);
+    }
+    return fillPercent;
+}
+
 bool LivePacketPool::detectDiscardVideoPacket() {
-    return recordingVideoPacketQueue->size() > VIDEO_PACKET_QUEUE_THRRESHOLD;
+    // 环形队列快满的时候不管预算如何都要丢
+    if (recordingVideoPacketQueue->size() >= VIDEO_PACKET_QUEUE_RING_CAPACITY - 1) {
+        return true;
+    }
+    return getVideoQueueFillPercent() > 100;
+}
+
+void LivePacketPool::detectVideoQueueWatermark() {
+    int fillPercent = getVideoQueueFillPercent();
+    int level = videoQueueWatermarkLevel;
+    if (VIDEO_QUEUE_WATERMARK_NORMAL == level && fillPercent >= videoQueueBudget.highWatermarkPercent) {
+        level = VIDEO_QUEUE_WATERMARK_HIGH;
+    } else if (VIDEO_QUEUE_WATERMARK_HIGH == level && fillPercent <= videoQueueBudget.lowWatermarkPercent) {
+        level = VIDEO_QUEUE_WATERMARK_NORMAL;
+    }
+    if (level != videoQueueWatermarkLevel) {
+        videoQueueWatermarkLevel = level;
+        printf("video queue watermark level %d fill percent %d\n", level, fillPercent);
+        if (NULL != onVideoQueueWatermarkCallback) {
+            onVideoQueueWatermarkCallback(level, fillPercent, watermarkContext);
+        }
+    }
 }
 
 bool LivePacketPool::pushRecordingVideoPacketToQueue(LiveVideoPacket *videoPacket) {
     bool dropFrame = false;
     if (NULL != recordingVideoPacketQueue) {
+        // 超过预算先从队头丢 GOP
         while (detectDiscardVideoPacket()) {
             dropFrame = true;
             int discardVideoFrameCnt = 0;
             int discardVideoFrameDuration = recordingVideoPacketQueue->discardGOP(&discardVideoFrameCnt);
-            if (discardVideoFrameDuration < 0) {
+            if (discardVideoFrameDuration < 0 || discardVideoFrameCnt == 0) {
+                // 队头丢不动，新来的帧一直丢到下一个 IDR
+                videoDropPolicy.skipUntilKeyFrame();
                 break;
             }
+            videoDropPolicy.recordGOPDrop(discardVideoFrameCnt, discardVideoFrameDuration);
             this->recordDropVideoFrame(discardVideoFrameDuration);
         }
         if (NULL != tempVideoPacket) {
             int packetDuration = videoPacket->timeMills - tempVideoPacket->timeMills;
             tempVideoPacket->duration = packetDuration;
-            recordingVideoPacketQueue->put(tempVideoPacket);
+            if (videoDropPolicy.shouldDropIncoming(tempVideoPacket, getVideoQueueFillPercent(), videoQueueBudget.highWatermarkPercent)) {
+                dropFrame = true;
+                dropIncomingVideoPacket(tempVideoPacket);
+            } else if (recordingVideoPacketQueue->isFull() && !makeRoomForVideoPacket(tempVideoPacket)) {
+                dropFrame = true;
+                dropIncomingVideoPacket(tempVideoPacket);
+            } else {
+                recordingVideoPacketQueue->put(tempVideoPacket);
+                detectVideoQueueWatermark();
+            }
             tempVideoPacketRefCnt = 0;
         }
         tempVideoPacket = videoPacket;
@@ -173,10 +332,30 @@ bool LivePacketPool::pushRecordingVideoPacketToQueue(LiveVideoPacket *videoPacke
     return dropFrame;
 }
 
+bool LivePacketPool::makeRoomForVideoPacket(LiveVideoPacket *videoPacket) {
+    if (!videoDropPolicy.shouldEvictForIncoming(videoPacket)) {
+        return false;
+    }
+    int discardVideoFrameCnt = 0;
+    int discardVideoFrameDuration = recordingVideoPacketQueue->discardGOP(&discardVideoFrameCnt, true);
+    if (discardVideoFrameDuration < 0 || discardVideoFrameCnt == 0) {
+        videoDropPolicy.skipUntilKeyFrame();
+        return false;
+    }
+    videoDropPolicy.recordGOPDrop(discardVideoFrameCnt, discardVideoFrameDuration);
+    this->recordDropVideoFrame(discardVideoFrameDuration);
+    return true;
+}
+
+void LivePacketPool::dropIncomingVideoPacket(LiveVideoPacket *videoPacket) {
+    // 音频按采样计数打时间戳，丢掉的 PCM 不占时间；视频不重排的话剩下的音频会比视频提前这么多
+    recordingVideoPacketQueue->startRetiming(videoPacket->timeMills);
+    this->recordDropVideoFrame(videoPacket->duration);
+    delete videoPacket;
+}
+
 void LivePacketPool::recordDropVideoFrame(int discardVideoFrameDuration) {
-    pthread_rwlock_wrlock(&mRwlock);
-    totalDiscardVideoPacketDuration += discardVideoFrameDuration;
-    pthread_rwlock_unlock(&mRwlock);
+    discardController.recordVideoDrop(discardVideoFrameDuration);
 }
 
 int LivePacketPool::getRecordingVideoPacketQueueSize() {
@@ -186,6 +365,20 @@ int LivePacketPool::getRecordingVideoPacketQueueSize() {
     return 0;
 }
 
+int64_t LivePacketPool::getRecordingVideoPacketQueueBytes() {
+    if (NULL != recordingVideoPacketQueue) {
+        return recordingVideoPacketQueue->bytes() + stagedVideoBytes.load(std::memory_order_relaxed);
+    }
+    return 0;
+}
+
+int LivePacketPool::getRecordingVideoPacketQueueDurationMills() {
+    if (NULL != recordingVideoPacketQueue) {
+        return recordingVideoPacketQueue->durationMills() + stagedVideoDurationMills.load(std::memory_order_relaxed);
+    }
+    return 0;
+}
+
 void LivePacketPool::clearRecordingVideoPacketToQueue() {
     if (NULL != recordingVideoPacketQueue) {
         return recordingVideoPacketQueue->flush();
@@ -11,58 +11,129 @@
 
 #include "live_audio_packet_queue.h"
 #include "live_video_packet_queue.h"
+#include "live_pcm_ring_buffer.h"
+#include "live_audio_drift_compensator.h"
+#include "live_audio_jitter_buffer.h"
+#include "live_buffer_pool.h"
+#include "live_video_drop_policy.h"
+#include "live_discard_controller.h"
 
-#define VIDEO_PACKET_QUEUE_THRRESHOLD                                        60
+#define VIDEO_PACKET_QUEUE_RING_CAPACITY                                     256
+#define VIDEO_PACKET_QUEUE_MAX_DURATION_MILLS                                2000
+#define VIDEO_PACKET_QUEUE_MAX_BYTES                                         0
+#define VIDEO_PACKET_QUEUE_HIGH_WATERMARK_PERCENT                            70
+#define VIDEO_PACKET_QUEUE_LOW_WATERMARK_PERCENT                             30
+
+#define VIDEO_QUEUE_WATERMARK_NORMAL                                         0
+#define VIDEO_QUEUE_WATERMARK_HIGH                                           1
 
 #define AUDIO_PACKET_DURATION_IN_SECS                                        0.04f
+#define AUDIO_PCM_RING_DURATION_IN_SECS                                      2
+
+/**
+ * 视频队列的预算，按字节数和时长限制，<= 0 表示不限制该项
+ * 超过预算时从队头丢 GOP，水位超过 highWatermarkPercent 和回落到 lowWatermarkPercent 以下时回调通知生产者
+ */
+typedef struct LiveVideoQueueBudget {
+    int64_t maxBytes;
+    int maxDurationMills;
+    int highWatermarkPercent;
+    int lowWatermarkPercent;
+} LiveVideoQueueBudget;
 
 class LivePacketPool {
-protected:
-    LivePacketPool();
-    static LivePacketPool* instance;
+public:
+    typedef void (*on_video_queue_watermark_callback)(int level, int fillPercent, void *context);
     
-    LiveAudioPacketQueue *audioPacketQueue;
+protected:
+    LivePCMRingBuffer *audioSampleRing;
+    LiveAudioDriftCompensator *audioDriftCompensator;
+    LiveAudioJitterBuffer *audioJitterBuffer;
+    LiveAudioJitterConfig audioJitterConfig;
     int audioSampleRate;
     int channels;
     
     LiveVideoPacketQueue *recordingVideoPacketQueue;
+    LiveBufferPool *videoBufferPool;
+    int videoCodec;
     
 private:
-    int totalDiscardVideoPacketDuration;
-    pthread_rwlock_t mRwlock;
+    LiveDiscardController discardController;
     
-    int bufferSize;
-    short *buffer;
-    int bufferCursor;
+    int bufferSize; // 一个 AUDIO_PACKET_DURATION_IN_SECS 对应的采样数，丢弃音频时的粒度
     
     bool detectDiscardVideoPacket();
+    /* 环形队列满了，按丢帧策略决定是丢掉队头给新包腾位置还是丢掉新包 */
+    bool makeRoomForVideoPacket(LiveVideoPacket *videoPacket);
+    /* 丢掉还没入队的帧：视频时间线跟着压缩之后才记音频欠账，音视频去掉的时长相同 */
+    void dropIncomingVideoPacket(LiveVideoPacket *videoPacket);
+    int getVideoQueueFillPercent();
+    void detectVideoQueueWatermark();
+    
+    LiveVideoDropPolicy videoDropPolicy;
+    
+    LiveVideoQueueBudget videoQueueBudget;
+    int videoQueueWatermarkLevel;
+    on_video_queue_watermark_callback onVideoQueueWatermarkCallback;
+    void *watermarkContext;
     
     LiveVideoPacket *tempVideoPacket;
     int tempVideoPacketRefCnt;
     
+    // 发送线程批量取走、还没交给 muxer 的包，仍然算在视频队列的预算里
+    std::atomic<int64_t> stagedVideoBytes;
+    std::atomic<int> stagedVideoDurationMills;
+    
 protected:
     virtual void recordDropVideoFrame(int discardVideoPacketSize);
 public:
-    static LivePacketPool* GetInstance();
+    LivePacketPool();
     virtual ~LivePacketPool();
     
     virtual void initAudioPacketQueue(int audioSampleRate);
     virtual void abortAudioPacketQueue();
     virtual void destroyAudioPacketQueue();
-    virtual int getAudioPacket(LiveAudioPacket **audioPacket, bool block);
+    virtual int getAudioSamples(short *samples, int sampleSize, double *timeMills, bool block);
+    virtual void pushAudioSamples(const short *samples, int sampleSize, double timeMills);
+    virtual void pushAudioSilence(int sampleSize, double timeMills);
+    /* 采集线程：captureTimeMills 是这一段到达时距离开始录制的时间，先修正音频时钟的漂移再写进 PCM 环形缓冲区 */
+    virtual void pushCapturedAudioSamples(const short *samples, int sampleSize, double captureTimeMills);
+    void getAudioDriftStats(LiveAudioDriftStats *stats);
+    /* 编码线程阻塞取 PCM 时经过的抖动缓冲的深度配置，要在 initAudioPacketQueue 之前设置 */
+    void setAudioJitterConfig(LiveAudioJitterConfig config);
+    void getAudioJitterStats(LiveAudioJitterStats *stats);
     virtual void pushAudioPacketToQueue(LiveAudioPacket *audioPacket);
     virtual int getAudioPacketQueueSize();
     
     bool discardAudioPacket();
     bool detectDiscardAudioPacket();
+    /* 给不经过 PCM 环形缓冲区的输出用：欠账够 durationMills 时记一次音频丢弃并返回 true，调用方丢掉这个 AAC 包 */
+    bool discardAudioDebt(int durationMills);
+    void getDiscardStats(LiveDiscardStats *stats);
+    
+    /* 从编码数据缓冲区池中借出 buffer 构造一个 size 大小的视频包，最后一个共享它的包析构时归还 */
+    LiveVideoPacket* obtainVideoPacket(int size);
+    /* obtainVideoPacket 出来的包的编码格式，默认 LIVE_VIDEO_CODEC_H264 */
+    void setVideoCodec(int videoCodec);
+    void getVideoBufferPoolStats(LiveBufferPoolStats *stats);
+    
+    void setVideoQueueBudget(LiveVideoQueueBudget budget);
+    void registerVideoQueueWatermarkCallback(on_video_queue_watermark_callback callback, void *context);
     
     void initRecordingVideoPacketQueue();
     void abortRecordingVideoPacketQueue();
     void destroyRecordingVideoPacketQueue();
     int getRecordingVideoPacket(LiveVideoPacket **videoPacket, bool block);
+    int getRecordingVideoPackets(LiveVideoPacket **videoPackets, int maxCount, int maxWaitMills);
+    /* getRecordingVideoPackets 取走的包写出或者丢弃时调用，之后不再计入队列预算 */
+    void releaseStagedVideoPacket(LiveVideoPacket *videoPacket);
     bool pushRecordingVideoPacketToQueue(LiveVideoPacket *videoPacket);
     int getRecordingVideoPacketQueueSize();
+    /* 字节数和时长包括发送线程已经取走还没写出的包 */
+    int64_t getRecordingVideoPacketQueueBytes();
+    int getRecordingVideoPacketQueueDurationMills();
     void clearRecordingVideoPacketToQueue();
+    void setRecordingVideoPacketNotifier(LivePacketNotifier *notifier);
 };
 
 #endif /* live_packet_pool_h */
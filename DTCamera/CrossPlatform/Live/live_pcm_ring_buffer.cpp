@@ -0,0 +1,188 @@
+//
+//  live_pcm_ring_buffer.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_pcm_ring_buffer.h"
+
+LivePCMRingBuffer::LivePCMRingBuffer(const char *nameParam, int capacityInSamples, int sampleRate, int channels) {
+    int64_t capacity = 2;
+    while (capacity < capacityInSamples) {
+        capacity <<= 1;
+    }
+    mMask = capacity - 1;
+    mSamples = new short[capacity];
+    mReadIndex.store(0);
+    mWriteIndex.store(0);
+    timestampTrack = new LiveSpscRingBuffer<LivePCMTimestamp>(PCM_TIMESTAMP_TRACK_CAPACITY);
+    lastTimestamp.sampleIndex = 0;
+    lastTimestamp.timeMills = -1;
+    this->sampleRate = sampleRate;
+    this->channels = channels;
+    overflowSamples.store(0);
+    mWaiters.store(0);
+    mAbortRequest = false;
+    pthread_mutex_init(&mLock, NULL);
+    platform_4_live::initMonotonicCondition(&mCondition);
+    name = nameParam;
+}
+
+LivePCMRingBuffer::~LivePCMRingBuffer() {
+    printf("%s ~LivePCMRingBuffer .... overflow samples %lld\n", name, (long long)overflowSamples.load());
+    delete[] mSamples;
+    delete timestampTrack;
+    pthread_mutex_destroy(&mLock);
+    pthread_cond_destroy(&mCondition);
+}
+
+int64_t LivePCMRingBuffer::getOverflowSamples() {
+    return overflowSamples.load(std::memory_order_relaxed);
+}
+
+int LivePCMRingBuffer::size() {
+    return (int)(mWriteIndex.load(std::memory_order_acquire) - mReadIndex.load(std::memory_order_acquire));
+}
+
+int LivePCMRingBuffer::reserve(int sampleSize, double timeMills, int64_t *writeIndex) {
+    int64_t w = mWriteIndex.load(std::memory_order_relaxed);
+    int64_t r = mReadIndex.load(std::memory_order_acquire);
+    int64_t free = mMask + 1 - (w - r);
+    int length = (int)MIN((int64_t)sampleSize, free);
+    if (length < sampleSize) {
+        overflowSamples.fetch_add(sampleSize - length, std::memory_order_relaxed);
+    }
+    if (length > 0 && timeMills >= 0) {
+        LivePCMTimestamp timestamp;
+        timestamp.sampleIndex = w;
+        timestamp.timeMills = timeMills;
+        timestampTrack->push(timestamp);
+    }
+    *writeIndex = w;
+    return length;
+}
+
+void LivePCMRingBuffer::commit(int64_t writeIndex, int sampleSize) {
+    mWriteIndex.store(writeIndex + sampleSize, std::memory_order_release);
+    // 和 read 里 mWaiters++ 之后重新检查配对，消费者没有挂起时不碰锁
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWaiters.load(std::memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&mLock);
+        pthread_cond_signal(&mCondition);
+        pthread_mutex_unlock(&mLock);
+    }
+}
+
+int LivePCMRingBuffer::write(const short *samples, int sampleSize, double timeMills) {
+    int64_t w = 0;
+    int length = reserve(sampleSize, timeMills, &w);
+    if (length <= 0) {
+        return 0;
+    }
+    int offset = (int)(w & mMask);
+    int firstPart = (int)MIN((int64_t)length, mMask + 1 - offset);
+    memcpy(mSamples + offset, samples, firstPart * sizeof(short));
+    if (firstPart < length) {
+        memcpy(mSamples, samples + firstPart, (length - firstPart) * sizeof(short));
+    }
+    commit(w, length);
+    return length;
+}
+
+int LivePCMRingBuffer::writeSilence(int sampleSize, double timeMills) {
+    int64_t w = 0;
+    int length = reserve(sampleSize, timeMills, &w);
+    if (length <= 0) {
+        return 0;
+    }
+    int offset = (int)(w & mMask);
+    int firstPart = (int)MIN((int64_t)length, mMask + 1 - offset);
+    memset(mSamples + offset, 0, firstPart * sizeof(short));
+    if (firstPart < length) {
+        memset(mSamples, 0, (length - firstPart) * sizeof(short));
+    }
+    commit(w, length);
+    return length;
+}
+
+double LivePCMRingBuffer::timeMillsAt(int64_t sampleIndex) {
+    LivePCMTimestamp timestamp;
+    while (timestampTrack->peek(&timestamp) && timestamp.sampleIndex <= sampleIndex) {
+        timestampTrack->pop(&timestamp);
+        lastTimestamp = timestamp;
+    }
+    if (lastTimestamp.timeMills < 0) {
+        return -1;
+    }
+    return lastTimestamp.timeMills + (double)(sampleIndex - lastTimestamp.sampleIndex) * 1000.0 / (double)(sampleRate * channels);
+}
+
+int LivePCMRingBuffer::waitForSamples(int sampleSize, int64_t deadlineMills) {
+    int64_t r = mReadIndex.load(std::memory_order_relaxed);
+    bool timeout = false;
+    for (;;) {
+        if (mAbortRequest) {
+            return -1;
+        }
+        if (mWriteIndex.load(std::memory_order_acquire) - r >= sampleSize) {
+            return sampleSize;
+        }
+        if (0 == deadlineMills || timeout) {
+            return 0;
+        }
+        pthread_mutex_lock(&mLock);
+        // 先登记为等待者再检查一次，和 commit 里的 fence 配对
+        mWaiters.fetch_add(1);
+        if (mWriteIndex.load() - r < sampleSize && !mAbortRequest) {
+            // 超时后最后再检查一次
+            timeout = ETIMEDOUT == platform_4_live::waitConditionUntil(&mCondition, &mLock, deadlineMills);
+        }
+        mWaiters.fetch_sub(1);
+        pthread_mutex_unlock(&mLock);
+    }
+}
+
+int LivePCMRingBuffer::read(short *samples, int sampleSize, double *timeMills, bool block) {
+    int ret = waitForSamples(sampleSize, block ? -1 : 0);
+    if (ret <= 0) {
+        return ret;
+    }
+    int64_t r = mReadIndex.load(std::memory_order_relaxed);
+    int offset = (int)(r & mMask);
+    int firstPart = (int)MIN((int64_t)sampleSize, mMask + 1 - offset);
+    memcpy(samples, mSamples + offset, firstPart * sizeof(short));
+    if (firstPart < sampleSize) {
+        memcpy(samples + firstPart, mSamples, (sampleSize - firstPart) * sizeof(short));
+    }
+    if (NULL != timeMills) {
+        (*timeMills) = timeMillsAt(r);
+    }
+    mReadIndex.store(r + sampleSize, std::memory_order_release);
+    return sampleSize;
+}
+
+int LivePCMRingBuffer::discard(int sampleSize) {
+    int64_t r = mReadIndex.load(std::memory_order_relaxed);
+    if (mWriteIndex.load(std::memory_order_acquire) - r < sampleSize) {
+        return 0;
+    }
+    timeMillsAt(r + sampleSize);
+    mReadIndex.store(r + sampleSize, std::memory_order_release);
+    return sampleSize;
+}
+
+void LivePCMRingBuffer::flush() {
+    printf("\n %s flush .... and this time the ring size is %d \n", name, size());
+    int64_t w = mWriteIndex.load(std::memory_order_acquire);
+    timeMillsAt(w);
+    mReadIndex.store(w, std::memory_order_release);
+}
+
+void LivePCMRingBuffer::abort() {
+    pthread_mutex_lock(&mLock);
+    mAbortRequest = true;
+    pthread_cond_broadcast(&mCondition);
+    pthread_mutex_unlock(&mLock);
+}
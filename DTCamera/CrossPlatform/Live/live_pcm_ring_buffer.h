@@ -0,0 +1,78 @@
+//
+//  live_pcm_ring_buffer.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_pcm_ring_buffer_h
+#define live_pcm_ring_buffer_h
+
+#include "platform_4_live_common.h"
+#include "live_spsc_ring_buffer.h"
+#include <pthread.h>
+#include <atomic>
+
+#define PCM_TIMESTAMP_TRACK_CAPACITY                                    256
+
+/** 一段采样写入时的时间戳，sampleIndex 是这段采样第一个 short 在整个流里的下标 **/
+typedef struct LivePCMTimestamp {
+    int64_t sampleIndex;
+    double timeMills;
+} LivePCMTimestamp;
+
+/**
+ * PCM 采样的单生产者单消费者环形缓冲区
+ * 采集线程把采样直接写进来，编码线程按编码器一帧的大小读出，中间不再分包、不再分配内存
+ * 时间戳放在一条并行的轨道上，读出时按照采样下标插值出这一段的起始时间
+ */
+class LivePCMRingBuffer {
+public:
+    LivePCMRingBuffer(const char *nameParam, int capacityInSamples, int sampleRate, int channels);
+    ~LivePCMRingBuffer();
+
+    /* 生产者：写入采样，timeMills < 0 表示不带时间戳，返回实际写入的采样数，放不下的部分丢弃 */
+    int write(const short *samples, int sampleSize, double timeMills);
+    int writeSilence(int sampleSize, double timeMills);
+
+    /* 消费者：读满 sampleSize 个采样，返回 < 0 if aborted, 0 if not enough samples and > 0 if read */
+    int read(short *samples, int sampleSize, double *timeMills, bool block);
+    /* 消费者：等到至少有 sampleSize 个采样或者到了单调时钟的 deadlineMills，deadlineMills < 0 表示一直等，返回值同 read */
+    int waitForSamples(int sampleSize, int64_t deadlineMills);
+    /* 消费者：丢弃 sampleSize 个采样，不够时不丢弃并返回 0 */
+    int discard(int sampleSize);
+    /* 写满时丢掉的采样数，写在采集回调里不打日志，只在这里累计，任意线程可读 */
+    int64_t getOverflowSamples();
+
+    int size();
+    void flush();
+    void abort();
+
+private:
+    int reserve(int sampleSize, double timeMills, int64_t *writeIndex);
+    void commit(int64_t writeIndex, int sampleSize);
+    double timeMillsAt(int64_t sampleIndex);
+
+    short *mSamples;
+    int64_t mMask;
+    std::atomic<int64_t> mReadIndex;
+    char mPadding[LIVE_CACHE_LINE_SIZE];
+    std::atomic<int64_t> mWriteIndex;
+    char mPadding1[LIVE_CACHE_LINE_SIZE];
+
+    LiveSpscRingBuffer<LivePCMTimestamp> *timestampTrack;
+    LivePCMTimestamp lastTimestamp;
+
+    int sampleRate;
+    int channels;
+    std::atomic<int64_t> overflowSamples;
+
+    std::atomic<int> mWaiters;
+    std::atomic<bool> mAbortRequest;
+    pthread_mutex_t mLock;
+    pthread_cond_t mCondition;
+    const char *name;
+};
+
+#endif /* live_pcm_ring_buffer_h */
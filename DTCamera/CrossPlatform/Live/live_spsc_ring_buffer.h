@@ -0,0 +1,126 @@
+//
+//  live_spsc_ring_buffer.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_spsc_ring_buffer_h
+#define live_spsc_ring_buffer_h
+
+#include <atomic>
+#include <stddef.h>
+
+#define LIVE_CACHE_LINE_SIZE                                            64
+
+/**
+ * 有界的单生产者单消费者环形队列，容量向上取整为 2 的幂
+ * push 只能在生产者线程调用，pop / peek 只能在消费者线程调用（或者由调用方保证消费者一侧互斥）
+ * 生产者和消费者各自写的索引放在不同的 cache line 上，避免 false sharing
+ */
+template <typename T>
+class LiveSpscRingBuffer {
+public:
+    LiveSpscRingBuffer(int capacityParam) {
+        size_t capacity = 2;
+        while (capacity < (size_t)capacityParam) {
+            capacity <<= 1;
+        }
+        mMask = capacity - 1;
+        mSlots = new T[capacity];
+        mHead.store(0, std::memory_order_relaxed);
+        mTail.store(0, std::memory_order_relaxed);
+        mCachedHead = 0;
+        mCachedTail = 0;
+    }
+
+    ~LiveSpscRingBuffer() {
+        delete[] mSlots;
+    }
+
+    bool push(const T &value) {
+        size_t tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mCachedHead > mMask) {
+            mCachedHead = mHead.load(std::memory_order_acquire);
+            if (tail - mCachedHead > mMask) {
+                return false;
+            }
+        }
+        mSlots[tail & mMask] = value;
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T *value) {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        if (head == mCachedTail) {
+            mCachedTail = mTail.load(std::memory_order_acquire);
+            if (head == mCachedTail) {
+                return false;
+            }
+        }
+        *value = mSlots[head & mMask];
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool peek(T *value) {
+        return peek(value, 0);
+    }
+
+    /* 查看距离队头 offset 个位置的元素 */
+    bool peek(T *value, int offset) {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        if (head + offset >= mCachedTail) {
+            mCachedTail = mTail.load(std::memory_order_acquire);
+            if (head + offset >= mCachedTail) {
+                return false;
+            }
+        }
+        *value = mSlots[(head + offset) & mMask];
+        return true;
+    }
+
+    /* 一次取出 count 个元素，只推进一次队头，不够时不取并返回 false */
+    bool popBulk(T *values, int count) {
+        size_t head = mHead.load(std::memory_order_relaxed);
+        if (head + count > mCachedTail) {
+            mCachedTail = mTail.load(std::memory_order_acquire);
+            if (head + count > mCachedTail) {
+                return false;
+            }
+        }
+        for (int i = 0; i < count; i++) {
+            values[i] = mSlots[(head + i) & mMask];
+        }
+        mHead.store(head + count, std::memory_order_release);
+        return true;
+    }
+
+    int size() {
+        size_t tail = mTail.load(std::memory_order_acquire);
+        size_t head = mHead.load(std::memory_order_acquire);
+        return (int)(tail - head);
+    }
+
+    int capacity() {
+        return (int)(mMask + 1);
+    }
+
+private:
+    char mPadding[LIVE_CACHE_LINE_SIZE];
+    // 消费者一侧
+    std::atomic<size_t> mHead;
+    size_t mCachedTail;
+    char mPadding0[LIVE_CACHE_LINE_SIZE];
+    // 生产者一侧
+    std::atomic<size_t> mTail;
+    size_t mCachedHead;
+    char mPadding1[LIVE_CACHE_LINE_SIZE];
+
+    T *mSlots;
+    size_t mMask;
+};
+
+#endif /* live_spsc_ring_buffer_h */
@@ -9,6 +9,7 @@
 #include "live_thread.h"
 
 LiveThread::LiveThread() {
+    mRunning = false;
     pthread_mutex_init(&mLock, NULL);
     pthread_cond_init(&mCondition, NULL);
 }
@@ -21,6 +22,8 @@ void LiveThread::start() {
 }
 
 void LiveThread::startAsync() {
+    // 先置位，紧接着调用 wait 时线程还没跑起来也能被 join
+    mRunning = true;
     pthread_create(&mThread, NULL, startThread, this);
 }
 
@@ -0,0 +1,88 @@
+//
+//  live_video_drop_policy.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "live_video_drop_policy.h"
+
+LiveVideoDropPolicy::LiveVideoDropPolicy() {
+    reset();
+}
+
+void LiveVideoDropPolicy::reset() {
+    isSkippingUntilKeyFrame = false;
+    droppedDisposableFrames = 0;
+    droppedDisposableMills = 0;
+    skippedFrames = 0;
+    skippedMills = 0;
+    droppedGOPFrames = 0;
+    droppedGOPMills = 0;
+}
+
+int LiveVideoDropPolicy::classify(LiveVideoPacket *videoPacket) {
+    if (videoPacket->isParameterSet()) {
+        return VIDEO_FRAME_PRIORITY_HEADER;
+    }
+    if (videoPacket->isIDRFrame()) {
+        return VIDEO_FRAME_PRIORITY_KEY;
+    }
+    if (videoPacket->isSEI()) {
+        return VIDEO_FRAME_PRIORITY_DISPOSABLE;
+    }
+    return videoPacket->getNALRefIdc() == 0 ? VIDEO_FRAME_PRIORITY_DISPOSABLE : VIDEO_FRAME_PRIORITY_REFERENCE;
+}
+
+bool LiveVideoDropPolicy::shouldDropIncoming(LiveVideoPacket *videoPacket, int fillPercent, int highWatermarkPercent) {
+    int priority = classify(videoPacket);
+    if (VIDEO_FRAME_PRIORITY_HEADER == priority) {
+        return false;
+    }
+    if (VIDEO_FRAME_PRIORITY_KEY == priority) {
+        isSkippingUntilKeyFrame = false;
+        return false;
+    }
+    if (isSkippingUntilKeyFrame) {
+        skippedFrames++;
+        skippedMills += videoPacket->duration;
+        return true;
+    }
+    if (VIDEO_FRAME_PRIORITY_DISPOSABLE == priority && fillPercent >= highWatermarkPercent) {
+        droppedDisposableFrames++;
+        droppedDisposableMills += videoPacket->duration;
+        return true;
+    }
+    return false;
+}
+
+void LiveVideoDropPolicy::skipUntilKeyFrame() {
+    if (!isSkippingUntilKeyFrame) {
+        printf("LiveVideoDropPolicy skip incoming frames until next key frame\n");
+    }
+    isSkippingUntilKeyFrame = true;
+}
+
+bool LiveVideoDropPolicy::shouldEvictForIncoming(LiveVideoPacket *videoPacket) {
+    if (classify(videoPacket) >= VIDEO_FRAME_PRIORITY_KEY) {
+        return true;
+    }
+    // 丢掉的是参考帧，后面的帧都解不出来了
+    skipUntilKeyFrame();
+    skippedFrames++;
+    skippedMills += videoPacket->duration;
+    return false;
+}
+
+void LiveVideoDropPolicy::recordGOPDrop(int discardVideoFrameCnt, int discardVideoFrameDuration) {
+    droppedGOPFrames += discardVideoFrameCnt;
+    droppedGOPMills += discardVideoFrameDuration;
+}
+
+void LiveVideoDropPolicy::dumpStats() {
+    printf("LiveVideoDropPolicy disposable %lld frames %lld ms, skipped %lld frames %lld ms, gop %lld frames %lld ms\n",
+           (long long)droppedDisposableFrames, (long long)droppedDisposableMills,
+           (long long)skippedFrames, (long long)skippedMills,
+           (long long)droppedGOPFrames, (long long)droppedGOPMills);
+}
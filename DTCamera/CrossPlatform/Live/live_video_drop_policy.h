@@ -0,0 +1,53 @@
+//
+//  live_video_drop_policy.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef live_video_drop_policy_h
+#define live_video_drop_policy_h
+
+#include "live_video_packet_queue.h"
+
+// 帧的优先级，数值越小越先被丢弃
+#define VIDEO_FRAME_PRIORITY_DISPOSABLE                                 0  // nal_ref_idc 为 0 的非参考帧（HEVC 的子层非参考帧）、单独的 SEI
+#define VIDEO_FRAME_PRIORITY_REFERENCE                                  1  // 参考 P 帧，丢了之后到下一个 IDR 之前都没法解码
+#define VIDEO_FRAME_PRIORITY_KEY                                        2  // IDR，HEVC 的 IRAP
+#define VIDEO_FRAME_PRIORITY_HEADER                                     3  // SPS/PPS（HEVC 还有 VPS），永远不丢
+
+/**
+ * 拥塞时的丢帧策略，按代价从低到高逐级升级：
+ * 1. 水位超过高水位时，丢掉新来的非参考帧
+ * 2. 超过预算时，从队头丢整个 GOP
+ * 3. 队头丢不动还是超过预算时，丢掉新来的帧直到下一个 IDR
+ * 4. 环形队列满了而新来的是参数集或 IDR 时，连同队头旧的参数集一起丢掉给它腾位置
+ */
+class LiveVideoDropPolicy {
+public:
+    LiveVideoDropPolicy();
+    
+    static int classify(LiveVideoPacket *videoPacket);
+    
+    void reset();
+    /* 入队前判断新的包要不要丢弃 */
+    bool shouldDropIncoming(LiveVideoPacket *videoPacket, int fillPercent, int highWatermarkPercent);
+    void skipUntilKeyFrame();
+    /* 环形队列满了，返回 true 表示应该强制丢掉队头给新的包腾位置，false 表示丢弃新的包并进入跳帧 */
+    bool shouldEvictForIncoming(LiveVideoPacket *videoPacket);
+    void recordGOPDrop(int discardVideoFrameCnt, int discardVideoFrameDuration);
+    void dumpStats();
+    
+private:
+    bool isSkippingUntilKeyFrame;
+    
+    int64_t droppedDisposableFrames;
+    int64_t droppedDisposableMills;
+    int64_t skippedFrames;
+    int64_t skippedMills;
+    int64_t droppedGOPFrames;
+    int64_t droppedGOPMills;
+};
+
+#endif /* live_video_drop_policy_h */
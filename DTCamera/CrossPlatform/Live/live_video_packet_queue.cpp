@@ -17,9 +17,35 @@ LiveVideoPacketQueue::LiveVideoPacketQueue(const char *queueNameParam) {
     queueName = queueNameParam;
 }
 
+LiveVideoPacketQueue::LiveVideoPacketQueue(const char *queueNameParam, int ringCapacity) {
+    init();
+    queueName = queueNameParam;
+    if (ringCapacity > 0) {
+        mRing = new LiveSpscRingBuffer<LiveVideoPacket *>(ringCapacity);
+        mDiscardScratch = new LiveVideoPacket*[mRing->capacity()];
+        if (ringCapacity > VIDEO_GOP_INDEX_CAPACITY) {
+            delete mGOPIndex;
+            mGOPIndex = new LiveSpscRingBuffer<LiveVideoGOPIndexEntry>(ringCapacity);
+        }
+    }
+}
+
 void LiveVideoPacketQueue::init() {
     pthread_mutex_init(&mLock, NULL);
-    pthread_cond_init(&mCondition, NULL);
+    platform_4_live::initMonotonicCondition(&mCondition);
+    mRing = NULL;
+    mDiscardScratch = NULL;
+    mWaiters.store(0);
+    mNotifier.store(NULL);
+    mGOPIndex = new LiveSpscRingBuffer<LiveVideoGOPIndexEntry>(VIDEO_GOP_INDEX_CAPACITY);
+    mPutSequence = 0;
+    mPutDuration = 0;
+    mPutBytes = 0;
+    mGetSequence = 0;
+    mGetDuration = 0;
+    mGetBytes = 0;
+    mQueuedBytes.store(0);
+    mQueuedDuration.store(0);
     mNbPackets = 0;
     mFrist = NULL;
     mLast = NULL;
@@ -30,26 +56,67 @@ void LiveVideoPacketQueue::init() {
 LiveVideoPacketQueue::~LiveVideoPacketQueue() {
     printf("%s ~PacketQueue ....\n", queueName);
     flush();
+    if (NULL != mRing) {
+        delete mRing;
+        mRing = NULL;
+    }
+    if (NULL != mDiscardScratch) {
+        delete[] mDiscardScratch;
+        mDiscardScratch = NULL;
+    }
+    delete mGOPIndex;
+    mGOPIndex = NULL;
     pthread_mutex_destroy(&mLock);
     pthread_cond_destroy(&mCondition);
 }
 
 int LiveVideoPacketQueue::size() {
+    if (NULL != mRing) {
+        return mRing->size();
+    }
     pthread_mutex_lock(&mLock);
     int size = mNbPackets;
     pthread_mutex_unlock(&mLock);
     return size;
 }
 
+bool LiveVideoPacketQueue::isFull() {
+    // 链表模式没有容量上限
+    return NULL != mRing && mRing->size() >= mRing->capacity();
+}
+
+int64_t LiveVideoPacketQueue::bytes() {
+    return mQueuedBytes.load(std::memory_order_relaxed);
+}
+
+int LiveVideoPacketQueue::durationMills() {
+    return (int)mQueuedDuration.load(std::memory_order_relaxed);
+}
+
 void LiveVideoPacketQueue::flush() {
     printf("\n %s flush .... and this time the queue size is %d \n", queueName, size());
     LiveVideoPacketList *pkt, *pkt1;
     LiveVideoPacket *videoPacket;
     pthread_mutex_lock(&mLock);
+    if (NULL != mRing) {
+        while (mRing->pop(&videoPacket)) {
+            mGetSequence++;
+            mGetDuration += videoPacket->duration;
+            mGetBytes += videoPacket->size;
+            mQueuedDuration -= videoPacket->duration;
+            mQueuedBytes -= videoPacket->size;
+            delete videoPacket;
+        }
+    }
     for (pkt = mFrist; pkt != NULL; pkt = pkt1) {
         pkt1 = pkt->next;
         videoPacket = pkt->pkt;
         if (NULL != videoPacket) {
+            mGetSequence++;
+            mGetDuration += videoPacket->duration;
+            mGetBytes += videoPacket->size;
+            mQueuedDuration -= videoPacket->duration;
+            mQueuedBytes -= videoPacket->size;
             delete videoPacket;
         }
         delete pkt;
@@ -58,14 +125,51 @@ void LiveVideoPacketQueue::flush() {
     mLast = NULL;
     mFrist = NULL;
     mNbPackets = 0;
+    trimGOPIndex();
     pthread_mutex_unlock(&mLock);
 }
 
+/* 生产者调用，给 IDR、SPS/PPS、SEI 这些 GOP 边界建索引；返回 false 表示索引满了 */
+bool LiveVideoPacketQueue::indexPacket(LiveVideoPacket *pkt, LiveVideoPacketList *node) {
+    bool ret = true;
+    if (pkt->isGOPBoundary()) {
+        LiveVideoGOPIndexEntry entry;
+        entry.sequence = mPutSequence;
+        entry.cumulativeDuration = mPutDuration;
+        entry.cumulativeBytes = mPutBytes;
+        entry.naluType = pkt->getNALUType();
+        entry.isKeyFrame = pkt->isIDRFrame();
+        entry.node = node;
+        if (!mGOPIndex->push(entry)) {
+            // 索引满了这个包会被当成普通帧，最坏情况是 discardGOP 多丢一个 GOP
+            printf("%s gop index is full, packet timeMills %d not indexed\n", queueName, pkt->timeMills);
+            ret = false;
+        }
+    }
+    mPutSequence++;
+    mPutDuration += pkt->duration;
+    mPutBytes += pkt->size;
+    mQueuedDuration += pkt->duration;
+    mQueuedBytes += pkt->size;
+    return ret;
+}
+
+/* 需要持有 mLock，去掉已经出队的包对应的索引 */
+void LiveVideoPacketQueue::trimGOPIndex() {
+    LiveVideoGOPIndexEntry entry;
+    while (mGOPIndex->peek(&entry) && entry.sequence < mGetSequence) {
+        mGOPIndex->pop(&entry);
+    }
+}
+
 int LiveVideoPacketQueue::put(LiveVideoPacket *pkt) {
     if (mAbortRequest) {
         delete pkt;
         return -1;
     }
+    if (NULL != mRing) {
+        return putToRing(pkt);
+    }
     LiveVideoPacketList *pkt1 = new LiveVideoPacketList();
     if (!pkt1) {
         return -1;
@@ -73,6 +177,7 @@ int LiveVideoPacketQueue::put(LiveVideoPacket *pkt) {
     pkt1->pkt = pkt;
     pkt1->next = NULL;
     pthread_mutex_lock(&mLock);
+    indexPacket(pkt, pkt1);
     if (mLast == NULL) {
         mFrist = pkt1;
     } else {
@@ -82,114 +187,214 @@ int LiveVideoPacketQueue::put(LiveVideoPacket *pkt) {
     mNbPackets++;
     pthread_cond_signal(&mCondition);
     pthread_mutex_unlock(&mLock);
+    notifyArrival();
     return 0;
 }
 
-int LiveVideoPacketQueue::discardGOP(int *discardVideoFrameCnt) {
+int LiveVideoPacketQueue::putToRing(LiveVideoPacket *pkt) {
+    // 只有生产者会 push，这里判断没满之后 push 一定成功，索引和包的序号不会错开
+    // LivePacketPool 入队前会用 isFull 检查并交给丢帧策略处理，走到这里说明调用方没有做溢出处理
+    if (mRing->size() >= mRing->capacity()) {
+        printf("%s is full, drop packet timeMills %d\n", queueName, pkt->timeMills);
+        delete pkt;
+        return -1;
+    }
+    // 先发布索引再发布包，消费者看到包的时候一定能看到它的索引
+    indexPacket(pkt, NULL);
+    mRing->push(pkt);
+    // 和消费者 mWaiters++ 之后重新检查队列配对，保证唤醒不会丢失；消费者没有挂起时不碰锁
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mWaiters.load(std::memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&mLock);
+        pthread_cond_signal(&mCondition);
+        pthread_mutex_unlock(&mLock);
+    }
+    notifyArrival();
+    return 0;
+}
+
+/* 以下两个方法需要持有 mLock，环形队列模式下 mLock 只用于消费者一侧和 discardGOP 之间的互斥 */
+bool LiveVideoPacketQueue::popFromQueue(LiveVideoPacket **pkt) {
+    if (NULL != mRing) {
+        if (!mRing->pop(pkt)) {
+            return false;
+        }
+    } else {
+        LiveVideoPacketList *pkt1 = mFrist;
+        if (!pkt1) {
+            return false;
+        }
+        mFrist = pkt1->next;
+        if (!mFrist) {
+            mLast = NULL;
+        }
+        mNbPackets--;
+        *pkt = pkt1->pkt;
+        delete pkt1;
+    }
+    mGetSequence++;
+    mGetDuration += (*pkt)->duration;
+    mGetBytes += (*pkt)->size;
+    mQueuedDuration -= (*pkt)->duration;
+    mQueuedBytes -= (*pkt)->size;
+    trimGOPIndex();
+    return true;
+}
+
+bool LiveVideoPacketQueue::peekFromQueue(LiveVideoPacket **pkt) {
+    if (NULL != mRing) {
+        return mRing->peek(pkt);
+    }
+    if (!mFrist) {
+        return false;
+    }
+    *pkt = mFrist->pkt;
+    return true;
+}
+
+int LiveVideoPacketQueue::discardGOP(int *discardVideoFrameCnt, bool includeParameterSets) {
     int discardVideoFrameDuration = 0;
     (*discardVideoFrameCnt) = 0;
-    LiveVideoPacketList *pktList = 0;
+    LiveVideoPacket *pkt = NULL;
+    int discardPacketCnt = 0;
+    LiveVideoPacketList *discardList = NULL;
+    LiveVideoPacketList *discardListEnd = NULL;
     pthread_mutex_lock(&mLock);
-    bool isFirstFrameIDR = false;
-    if (mFrist) {
-        LiveVideoPacket *pkt = mFrist->pkt;
-        if (pkt) {
-            int nalu_type = pkt->getNALUType();
-            if (nalu_type == H264_NALU_TYPE_IDR_PICTURE) {
-                isFirstFrameIDR = true;
+    if (mAbortRequest || !peekFromQueue(&pkt) || NULL == pkt) {
+        pthread_mutex_unlock(&mLock);
+        return 0;
+    }
+    // 队头如果是 GOP 边界，索引的第一项就是它
+    LiveVideoGOPIndexEntry first;
+    LiveVideoGOPIndexEntry end;
+    bool hasFirst = mGOPIndex->peek(&first);
+    int endOffset = 0;
+    if (hasFirst && first.sequence == mGetSequence) {
+        if (!first.isKeyFrame) {
+            if (!includeParameterSets) {
+                // sps pps 的问题
+                pthread_mutex_unlock(&mLock);
+                printf("discardVideoFrameDuration is %d\n", -1);
+                return -1;
+            }
+            // 跳过队头连续的参数集，连同后面 IDR 开始的整个 GOP 一起丢；没有 IDR 就丢掉整个队列
+            LiveVideoGOPIndexEntry entry;
+            while (mGOPIndex->peek(&entry, endOffset) && !entry.isKeyFrame) {
+                endOffset++;
+            }
+            if (mGOPIndex->peek(&entry, endOffset)) {
+                endOffset++;
             }
+        } else {
+            endOffset = 1;
         }
     }
-    for (;;) {
-        if (mAbortRequest) {
-            discardVideoFrameDuration = 0;
-            break;
+    // 丢到下一个 GOP 边界为止，没有边界就丢掉整个队列；discardGOP 在生产者线程调用，入队计数此时是稳定的
+    if (!mGOPIndex->peek(&end, endOffset)) {
+        end.sequence = mPutSequence;
+        end.cumulativeDuration = mPutDuration;
+        end.cumulativeBytes = mPutBytes;
+        end.node = NULL;
+    }
+    int count = (int)(end.sequence - mGetSequence);
+    if (count > 0) {
+        if (NON_DROP_FRAME_FLAG == currentTimeMills) {
+            currentTimeMills = pkt->timeMills;
         }
-        pktList = mFrist;
-        if (pktList) {
-            LiveVideoPacket *pkt = pktList->pkt;
-            if (pkt) {
-                int nalu_type = pkt->getNALUType();
-                if (NON_DROP_FRAME_FLAG == currentTimeMills) {
-                    currentTimeMills = pkt->timeMills;
-                }
-                if (nalu_type == H264_NALU_TYPE_IDR_PICTURE) {
-                    if (isFirstFrameIDR) {
-                        isFirstFrameIDR = false;
-                        mFrist = pktList->next;
-                        if (!mFrist) {
-                            mLast = NULL;
-                        }
-                        discardVideoFrameDuration += pkt->duration;
-                        (*discardVideoFrameCnt)++;
-                        mNbPackets--;
-                        delete pkt;
-                        pkt = NULL;
-                        delete pktList;
-                        pktList = NULL;
-                        continue;
-                    } else {
-                        break;
-                    }
-                } else if (nalu_type == H264_NALU_TYPE_NON_IDR_PICTURE) {
-                    mFrist = pktList->next;
-                    if (!mFrist) {
-                        mLast = NULL;
-                    }
-                    discardVideoFrameDuration += pkt->duration;
-                    (*discardVideoFrameCnt)++;
-                    mNbPackets--;
-                    delete pkt;
-                    pkt = NULL;
-                    delete pktList;
-                    pktList = NULL;
-                    continue;
-                } else {
-                    // sps pps 的问题
-                    discardVideoFrameDuration = -1;
-                    break;
-                }
+        discardVideoFrameDuration = (int)(end.cumulativeDuration - mGetDuration);
+        (*discardVideoFrameCnt) = count;
+        if (NULL != mRing) {
+            // 草稿数组只在生产者线程用，容量和环形队列一样，锁里只拷贝指针
+            if (mRing->popBulk(mDiscardScratch, count)) {
+                discardPacketCnt = count;
             }
         } else {
-            break;
+            // 直接把 [mFrist, end.node) 这一段摘下来
+            discardList = mFrist;
+            discardListEnd = end.node;
+            mFrist = end.node;
+            if (!mFrist) {
+                mLast = NULL;
+            }
+            mNbPackets -= count;
         }
+        mQueuedDuration -= end.cumulativeDuration - mGetDuration;
+        mQueuedBytes -= end.cumulativeBytes - mGetBytes;
+        mGetSequence = end.sequence;
+        mGetDuration = end.cumulativeDuration;
+        mGetBytes = end.cumulativeBytes;
+        trimGOPIndex();
     }
     pthread_mutex_unlock(&mLock);
+    // 摘下来的包在锁外释放
+    for (int i = 0; i < discardPacketCnt; i++) {
+        delete mDiscardScratch[i];
+        mDiscardScratch[i] = NULL;
+    }
+    while (NULL != discardList && discardList != discardListEnd) {
+        LiveVideoPacketList *next = discardList->next;
+        delete discardList->pkt;
+        delete discardList;
+        discardList = next;
+    }
     printf("discardVideoFrameDuration is %d\n", discardVideoFrameDuration);
     return discardVideoFrameDuration;
 }
 
+void LiveVideoPacketQueue::startRetiming(int droppedTimeMills) {
+    LiveVideoPacket *pkt = NULL;
+    pthread_mutex_lock(&mLock);
+    if (NON_DROP_FRAME_FLAG == currentTimeMills) {
+        // 队列空着时下一个入队的包接替被丢的帧的时间
+        currentTimeMills = peekFromQueue(&pkt) && NULL != pkt ? pkt->timeMills : droppedTimeMills;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
 int LiveVideoPacketQueue::get(LiveVideoPacket **pkt, bool block) {
-    LiveVideoPacketList *pkt1;
-    int ret;
+    return getBatchUntil(pkt, 1, block ? -1 : 0);
+}
+
+int LiveVideoPacketQueue::getUntil(LiveVideoPacket **pkt, int64_t deadlineMills) {
+    return getBatchUntil(pkt, 1, deadlineMills);
+}
+
+int LiveVideoPacketQueue::getBatch(LiveVideoPacket **pkts, int maxCount, int maxWaitMills) {
+    return getBatchUntil(pkts, maxCount, platform_4_live::getDeadlineMills(maxWaitMills));
+}
+
+int LiveVideoPacketQueue::getBatchUntil(LiveVideoPacket **pkts, int maxCount, int64_t deadlineMills) {
+    int ret = 0;
+    bool timeout = false;
     pthread_mutex_lock(&mLock);
     for (;;) {
         if (mAbortRequest) {
             ret = -1;
             break;
         }
-        pkt1 = mFrist;
-        if (pkt1) {
-            mFrist = pkt1->next;
-            if (!mFrist) {
-                mLast = NULL;
-            }
-            mNbPackets--;
-            *pkt = pkt1->pkt;
+        while (ret < maxCount && popFromQueue(&pkts[ret])) {
             if (NON_DROP_FRAME_FLAG != currentTimeMills) {
-                (*pkt)->timeMills = currentTimeMills;
-                currentTimeMills += (*pkt)->duration;
+                pkts[ret]->timeMills = currentTimeMills;
+                currentTimeMills += pkts[ret]->duration;
             }
-            delete pkt1;
-            pkt1 = NULL;
-            ret = 1;
-            break;
-        } else if (!block) {
-            ret = 0;
+            ret++;
+        }
+        if (ret > 0 || timeout) {
             break;
+        }
+        int waitRet = 0;
+        if (NULL != mRing) {
+            // 先登记为等待者再检查一次，和 putToRing 里的 fence 配对
+            mWaiters.fetch_add(1);
+            if (mRing->size() == 0 && !mAbortRequest) {
+                waitRet = platform_4_live::waitConditionUntil(&mCondition, &mLock, deadlineMills);
+            }
+            mWaiters.fetch_sub(1);
         } else {
-            pthread_cond_wait(&mCondition, &mLock);
+            waitRet = platform_4_live::waitConditionUntil(&mCondition, &mLock, deadlineMills);
         }
+        // 超时后最后再取一次
+        timeout = ETIMEDOUT == waitRet;
     }
     pthread_mutex_unlock(&mLock);
     return ret;
@@ -198,6 +403,18 @@ int LiveVideoPacketQueue::get(LiveVideoPacket **pkt, bool block) {
 void LiveVideoPacketQueue::abort() {
     pthread_mutex_lock(&mLock);
     mAbortRequest = true;
-    pthread_cond_signal(&mCondition);
+    pthread_cond_broadcast(&mCondition);
     pthread_mutex_unlock(&mLock);
+    notifyArrival();
+}
+
+void LiveVideoPacketQueue::setNotifier(LivePacketNotifier *notifier) {
+    mNotifier.store(notifier);
+}
+
+void LiveVideoPacketQueue::notifyArrival() {
+    LivePacketNotifier *notifier = mNotifier.load(std::memory_order_acquire);
+    if (NULL != notifier) {
+        notifier->notify();
+    }
 }
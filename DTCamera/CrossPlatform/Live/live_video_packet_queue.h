@@ -10,19 +10,65 @@
 #define live_video_packet_queue_h
 
 #include "platform_4_live_common.h"
+#include "live_spsc_ring_buffer.h"
+#include "live_buffer_pool.h"
+#include "live_nal_parser.h"
+#include "live_packet_notifier.h"
 #include <pthread.h>
-
-#define H264_NALU_TYPE_NON_IDR_PICTURE                                  1
-#define H264_NALU_TYPE_IDR_PICTURE                                      5
-#define H264_NALU_TYPE_SEQUENCE_PARAMETER_SET                           7
-#define H264_NALU_TYPE_PICTURE_PARAMETER_SET                            8
-#define H264_NALU_TYPE_SEI                                              6
+#include <atomic>
 
 #define NON_DROP_FRAME_FLAG                                             -1.0f
 #define DTS_PARAM_UN_SETTIED_FLAG                                        -1
 #define DTS_PARAM_NOT_A_NUM_FLAG                                        -2
 #define PTS_PARAM_UN_SETTIED_FLAG                                        -1
 
+/**
+ * 编码数据，多个 LiveVideoPacket 可以共享同一份，引用计数归零时把 buffer 还给池子
+ * 共享之后数据只读，需要修改的一方先调用 LiveVideoPacket::makeWritable
+ */
+typedef struct LiveVideoPayload {
+    byte *data;
+    int capacity;
+    LiveBufferPool *bufferPool; // 不为空时 data 从这个池子借出
+    std::atomic<int> refCount;
+    
+    LiveVideoPayload(LiveBufferPool *pool, int size) {
+        bufferPool = pool;
+        data = NULL != pool ? pool->obtain(size) : new byte[size];
+        capacity = size;
+        refCount.store(1, std::memory_order_relaxed);
+    }
+    
+    LiveVideoPayload* retain() {
+        refCount.fetch_add(1, std::memory_order_relaxed);
+        return this;
+    }
+    
+    void release() {
+        if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+    
+    bool isShared() {
+        return refCount.load(std::memory_order_acquire) > 1;
+    }
+    
+private:
+    ~LiveVideoPayload() {
+        if (NULL != bufferPool) {
+            bufferPool->recycle(data);
+        } else {
+            delete[] data;
+        }
+        data = NULL;
+    }
+} LiveVideoPayload;
+
+/**
+ * buffer / size 指向共享的编码数据，pts / dts / timeMills / duration 是每个包自己的
+ * payload 为空时 buffer 由包自己持有（new[] 出来的），析构时直接释放
+ */
 typedef struct LiveVideoPacket {
     byte *buffer;
     int size;
@@ -30,45 +76,161 @@ typedef struct LiveVideoPacket {
     int duration;
     int64_t pts;
     int64_t dts;
+    int codec; // LIVE_VIDEO_CODEC_H264 / LIVE_VIDEO_CODEC_HEVC，决定 NAL 头怎么解析
+    int naluOffset; // 代表这个包的 NAL 头的位置，第一次用到时才扫描，-1 表示还没找
+    LiveVideoPayload *payload;
     
     LiveVideoPacket() {
         buffer = NULL;
+        payload = NULL;
+        codec = LIVE_VIDEO_CODEC_H264;
+        naluOffset = -1;
         size = 0;
+        timeMills = 0;
+        duration = 0;
         pts = PTS_PARAM_UN_SETTIED_FLAG;
         dts = DTS_PARAM_UN_SETTIED_FLAG;
     }
     
     ~LiveVideoPacket() {
-        if (NULL != buffer) {
+        if (NULL != payload) {
+            payload->release();
+            payload = NULL;
+        } else if (NULL != buffer) {
             delete[] buffer;
-            buffer = NULL;
         }
+        buffer = NULL;
     }
     
+    /* 包里可能有多个 NAL，取代表整个访问单元的那个，见 LiveNALParser::findPrimaryNAL */
+    int getNALUOffset() {
+        if (naluOffset < 0) {
+            naluOffset = LiveNALParser::findPrimaryNAL(buffer, size, codec);
+            if (naluOffset < 0) {
+                naluOffset = LIVE_NAL_LENGTH_SIZE;
+            }
+        }
+        return naluOffset;
+    }
+    
+    /* H.264 取 5 位，HEVC 取 6 位 */
     int getNALUType() {
-        int nalu_type = H264_NALU_TYPE_NON_IDR_PICTURE;
-        if (NULL != buffer) {
-            nalu_type = buffer[4] & 0x1F;
+        if (NULL == buffer || getNALUOffset() >= size) {
+            return LIVE_VIDEO_CODEC_HEVC == codec ? 1 : H264_NALU_TYPE_NON_IDR_PICTURE;
+        }
+        return LiveNALParser::getNALUType(buffer + naluOffset, codec);
+    }
+    
+    /* HEVC 没有 nal_ref_idc，16 以下的偶数类型是子层非参考帧，按 0 返回 */
+    int getNALRefIdc() {
+        if (NULL == buffer || getNALUOffset() >= size) {
+            return 1;
+        }
+        if (LIVE_VIDEO_CODEC_HEVC == codec) {
+            int nalu_type = getNALUType();
+            return (nalu_type < HEVC_NALU_TYPE_BLA_W_LP && nalu_type % 2 == 0) ? 0 : 1;
         }
-        return nalu_type;
+        return (buffer[naluOffset] >> 5) & 0x03;
     }
     
+    /* H.264 的 IDR，HEVC 的 IRAP */
     bool isIDRFrame() {
-        bool ret = false;
-        if (getNALUType() == H264_NALU_TYPE_IDR_PICTURE) {
-            ret = true;
+        int nalu_type = getNALUType();
+        if (LIVE_VIDEO_CODEC_HEVC == codec) {
+            return nalu_type >= HEVC_NALU_TYPE_BLA_W_LP && nalu_type <= HEVC_NALU_TYPE_RSV_IRAP_VCL23;
         }
-        return ret;
+        return nalu_type == H264_NALU_TYPE_IDR_PICTURE;
     }
     
+    bool isParameterSet() {
+        return LiveNALParser::isParameterSet(getNALUType(), codec);
+    }
+    
+    bool isSEI() {
+        int nalu_type = getNALUType();
+        if (LIVE_VIDEO_CODEC_HEVC == codec) {
+            return nalu_type == HEVC_NALU_TYPE_PREFIX_SEI || nalu_type == HEVC_NALU_TYPE_SUFFIX_SEI;
+        }
+        return nalu_type == H264_NALU_TYPE_SEI;
+    }
+    
+    /* IDR / IRAP、参数集、SEI 等不是普通帧的包，GOP 索引只记录这些 */
+    bool isGOPBoundary() {
+        if (LIVE_VIDEO_CODEC_HEVC == codec) {
+            return isIDRFrame() || isParameterSet() || isSEI();
+        }
+        return getNALUType() != H264_NALU_TYPE_NON_IDR_PICTURE;
+    }
+    
+    /* 浅拷贝：共享编码数据，只复制元数据 */
     LiveVideoPacket* clone() {
         LiveVideoPacket *result = new LiveVideoPacket();
-        result->buffer = new byte[size];
-        memcpy(result->buffer, buffer, size);
+        if (NULL != payload) {
+            result->payload = payload->retain();
+            result->buffer = buffer;
+        } else {
+            result->buffer = new byte[size];
+            memcpy(result->buffer, buffer, size);
+        }
         result->size = size;
         result->timeMills = timeMills;
+        result->duration = duration;
+        result->pts = pts;
+        result->dts = dts;
+        result->codec = codec;
+        result->naluOffset = naluOffset;
         return result;
     }
+    
+    /* 编码数据被别的包共享时复制一份私有的，之后可以原地修改 buffer */
+    void makeWritable() {
+        if (NULL == payload || !payload->isShared()) {
+            return;
+        }
+        LiveVideoPayload *writable = new LiveVideoPayload(payload->bufferPool, size);
+        memcpy(writable->data, buffer, size);
+        payload->release();
+        payload = writable;
+        buffer = writable->data;
+    }
+    
+    /*
+     * 起始码格式（3 / 4 字节起始码，一个包里可以有多个 NAL）转成 4 字节长度前缀，已经是长度前缀的不动
+     * 起始码都是 4 字节时原地转换，否则转换后会变长，写到从同一个池子借出的新缓冲区里
+     * 切不出 NAL 时返回 false
+     */
+    bool convertToAVCC() {
+        if (NULL == buffer || size <= 0) {
+            return false;
+        }
+        if (LiveNALParser::isAVCC(buffer, size)) {
+            return true;
+        }
+        LiveNALUnit units[LIVE_NAL_MAX_UNITS];
+        int count = LiveNALParser::splitAnnexB(buffer, size, units, LIVE_NAL_MAX_UNITS);
+        if (count <= 0) {
+            return false;
+        }
+        if (LiveNALParser::canConvertInPlace(units, count)) {
+            makeWritable();
+            size = LiveNALParser::writeAVCC(buffer, units, count, buffer);
+        } else {
+            int avccSize = LiveNALParser::getAVCCSize(units, count);
+            LiveVideoPayload *converted = new LiveVideoPayload(NULL != payload ? payload->bufferPool : NULL, avccSize);
+            LiveNALParser::writeAVCC(buffer, units, count, converted->data);
+            if (NULL != payload) {
+                payload->release();
+            } else {
+                delete[] buffer;
+            }
+            payload = converted;
+            buffer = converted->data;
+            size = avccSize;
+        }
+        // NAL 的位置变了，用到时重新找
+        naluOffset = -1;
+        return true;
+    }
 } LiveVideoPacket;
 
 typedef struct LiveVideoPacketList {
@@ -80,10 +242,27 @@ typedef struct LiveVideoPacketList {
     }
 } LiveVideoPacketList;
 
+/**
+ * GOP 索引的一项，记录队列中每个不是普通 P 帧的包（IDR、SPS/PPS、SEI）
+ * sequence 是包入队的序号，cumulativeDuration / cumulativeBytes 是它之前所有入队包的时长 / 字节数之和
+ */
+typedef struct LiveVideoGOPIndexEntry {
+    int64_t sequence;
+    int64_t cumulativeDuration;
+    int64_t cumulativeBytes;
+    int naluType;
+    bool isKeyFrame;
+    LiveVideoPacketList *node; // 链表模式下对应的节点
+} LiveVideoGOPIndexEntry;
+
+#define VIDEO_GOP_INDEX_CAPACITY                                        1024
+
 class LiveVideoPacketQueue {
 public:
     LiveVideoPacketQueue();
     LiveVideoPacketQueue(const char *queueNameParam);
+    /* ringCapacity > 0 时使用有界的 SPSC 环形队列，put 不加锁也不分配链表节点 */
+    LiveVideoPacketQueue(const char *queueNameParam, int ringCapacity);
     ~LiveVideoPacketQueue();
     
     void init();
@@ -91,15 +270,58 @@ public:
     int put(LiveVideoPacket *videoPacket);
     /* return < 0 if aborted, 0 if no packet and > 0 if packet. */
     int get(LiveVideoPacket **videoPacket, bool block);
-    int discardGOP(int *discardVideoFrameCnt);
+    /* 等到单调时钟的 deadlineMills（< 0 一直等），return < 0 if aborted, 0 if timeout and > 0 if packet. */
+    int getUntil(LiveVideoPacket **videoPacket, int64_t deadlineMills);
+    /**
+     * 一次加锁取出最多 maxCount 个包，队列为空时最多等待 maxWaitMills 毫秒（< 0 一直等，0 不等）
+     * 等到第一个包之后不再等待，队列里已有的包一起取走
+     * return < 0 if aborted, 0 if timeout and > 0 the packet count.
+     */
+    int getBatch(LiveVideoPacket **videoPackets, int maxCount, int maxWaitMills);
+    int getBatchUntil(LiveVideoPacket **videoPackets, int maxCount, int64_t deadlineMills);
+    /* 丢弃队头的一个 GOP，返回丢弃的时长，队头是 SPS/PPS/SEI 时返回 -1；需要在生产者线程调用
+     * includeParameterSets 为 true 时队头的参数集连同后面的 GOP 一起丢，用在新的参数集或 IDR 要入队而队列已满的时候 */
+    int discardGOP(int *discardVideoFrameCnt, bool includeParameterSets = false);
+    /* 新来的帧没进队列就被丢掉时调用，和 discardGOP 一样从队头开始按时长重排时间戳，丢掉的时长从视频时间线上去掉；需要在生产者线程调用 */
+    void startRetiming(int droppedTimeMills);
     int size();
+    /* 环形队列已满，下一次 put 会失败；只有生产者线程调用时结果才是稳定的 */
+    bool isFull();
+    /* 队列中数据的字节数和时长，入队出队时增量维护，任意线程可读 */
+    int64_t bytes();
+    int durationMills();
     void abort();
+    /* 入队和 abort 时额外通知 notifier，发送线程可以同时等多个队列；传 NULL 取消 */
+    void setNotifier(LivePacketNotifier *notifier);
     
 private:
+    int putToRing(LiveVideoPacket *videoPacket);
+    bool popFromQueue(LiveVideoPacket **videoPacket);
+    bool peekFromQueue(LiveVideoPacket **videoPacket);
+    bool indexPacket(LiveVideoPacket *videoPacket, LiveVideoPacketList *node);
+    void trimGOPIndex();
+    void notifyArrival();
+    
+    LiveSpscRingBuffer<LiveVideoGOPIndexEntry> *mGOPIndex;
+    // 生产者一侧：入队的包数、时长和字节数之和
+    int64_t mPutSequence;
+    int64_t mPutDuration;
+    int64_t mPutBytes;
+    // 消费者一侧：出队（包括丢弃）的包数、时长和字节数之和，受 mLock 保护
+    int64_t mGetSequence;
+    int64_t mGetDuration;
+    int64_t mGetBytes;
+    std::atomic<int64_t> mQueuedBytes;
+    std::atomic<int64_t> mQueuedDuration;
+    
+    LiveSpscRingBuffer<LiveVideoPacket *> *mRing;
+    LiveVideoPacket **mDiscardScratch; // discardGOP 摘包用的草稿数组，和 mRing 一起分配
+    std::atomic<int> mWaiters; // 环形队列模式下阻塞在 mCondition 上的消费者数量
+    std::atomic<LivePacketNotifier *> mNotifier;
     LiveVideoPacketList *mFrist;
     LiveVideoPacketList *mLast;
     int mNbPackets;
-    bool mAbortRequest;
+    std::atomic<bool> mAbortRequest;
     pthread_mutex_t mLock;
     pthread_cond_t mCondition;
     const char *queueName;
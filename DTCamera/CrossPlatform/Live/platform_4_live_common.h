@@ -10,6 +10,11 @@
 #include <math.h>
 #include <stdlib.h>
 #include <sys/time.h>
+#include <time.h>
+#include <errno.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "live_clock.h"
 
 typedef unsigned char byte;
 
@@ -25,7 +30,11 @@ typedef unsigned char byte;
 #define MIN(a, b)  (((a) < (b)) ? (a) : (b))
 #endif
 
+// 虚拟时钟下定时等待每次最多睡这么久（真实时间），醒来按虚拟时间重新判断是否超时
+#define LIVE_VIRTUAL_CLOCK_WAIT_SLICE_MILLS      1
+
 namespace platform_4_live {
+// 墙上时间，会随着系统时间修改和 NTP 校时跳变，只能用来打日志，计时一律用 getMonotonicTimeMills
 static inline long getCurrentTimeMills()
 {
    struct timeval tv;
@@ -39,6 +48,78 @@ static inline long getCurrentTimeSeconds() {
     return tv.tv_sec;
 }
 
+// 单调时钟，不受系统时间修改的影响，用来计时和计算等待的截止时间；时间源可以用 LiveClock::setClock 替换
+static inline int64_t getMonotonicTimeNanos() {
+    return LiveClock::getClock()->getTimeNanos();
+}
+
+static inline int64_t getMonotonicTimeMills() {
+    return getMonotonicTimeNanos() / 1000000;
+}
+
+// 把 maxWaitMills 换算成单调时钟上的截止时间，maxWaitMills < 0 表示一直等，返回 -1
+static inline int64_t getDeadlineMills(int maxWaitMills) {
+    return maxWaitMills < 0 ? -1 : getMonotonicTimeMills() + maxWaitMills;
+}
+
+// 初始化按单调时钟计时的条件变量
+static inline void initMonotonicCondition(pthread_cond_t *condition) {
+#if defined(__APPLE__)
+    // Darwin 不支持 pthread_condattr_setclock，等待时用相对时间
+    pthread_cond_init(condition, NULL);
+#else
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(condition, &attr);
+    pthread_condattr_destroy(&attr);
+#endif
+}
+
+// 在 initMonotonicCondition 初始化的条件变量上等到 deadlineMills，deadlineMills < 0 表示一直等，超时返回 ETIMEDOUT
+static inline int waitConditionUntil(pthread_cond_t *condition, pthread_mutex_t *mutex, int64_t deadlineMills) {
+    if (deadlineMills < 0) {
+        return pthread_cond_wait(condition, mutex);
+    }
+    int64_t remainMills = deadlineMills - getMonotonicTimeMills();
+    if (remainMills <= 0) {
+        return ETIMEDOUT;
+    }
+    if (LiveClock::getClock()->isVirtual()) {
+        // 按真实时间睡一小段就返回，调用方都会在循环里重新检查条件和截止时间，虚拟时间到了才算超时
+        struct timespec reltime;
+        reltime.tv_sec = 0;
+        reltime.tv_nsec = LIVE_VIRTUAL_CLOCK_WAIT_SLICE_MILLS * 1000000L;
+#if defined(__APPLE__)
+        int ret = pthread_cond_timedwait_relative_np(condition, mutex, &reltime);
+#else
+        struct timespec abstime;
+        clock_gettime(CLOCK_MONOTONIC, &abstime);
+        long nsec = abstime.tv_nsec + reltime.tv_nsec;
+        abstime.tv_sec += nsec / 1000000000L;
+        abstime.tv_nsec = nsec % 1000000000L;
+        int ret = pthread_cond_timedwait(condition, mutex, &abstime);
+#endif
+        if (ETIMEDOUT == ret) {
+            return getMonotonicTimeMills() >= deadlineMills ? ETIMEDOUT : 0;
+        }
+        return ret;
+    }
+#if defined(__APPLE__)
+    struct timespec reltime;
+    reltime.tv_sec = (time_t)(remainMills / 1000);
+    reltime.tv_nsec = (long)(remainMills % 1000) * 1000000L;
+    return pthread_cond_timedwait_relative_np(condition, mutex, &reltime);
+#else
+    struct timespec abstime;
+    clock_gettime(CLOCK_MONOTONIC, &abstime);
+    long nsec = abstime.tv_nsec + (long)(remainMills % 1000) * 1000000L;
+    abstime.tv_sec += (time_t)(remainMills / 1000) + nsec / 1000000000L;
+    abstime.tv_nsec = nsec % 1000000000L;
+    return pthread_cond_timedwait(condition, mutex, &abstime);
+#endif
+}
+
 }
 #define LIVEVIDEO_DEBUG 1
 // log
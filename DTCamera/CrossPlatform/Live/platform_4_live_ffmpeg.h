@@ -41,4 +41,18 @@ extern "C" {
 }
 #endif
 
+// 打包进来的 FFmpeg 版本不固定，新接口按 libavcodec 的版本号开关，老版本走原来的接口
+// av_frame_alloc / av_frame_free 从 lavc 55.28.1 开始替代 avcodec_alloc_frame
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(55, 28, 1)
+#define LIVE_FFMPEG_HAS_FRAME_ALLOC                                     1
+#endif
+// avcodec_send_frame / avcodec_receive_packet 从 lavc 57.37.100 开始有，av_packet_alloc 更早
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 37, 100)
+#define LIVE_FFMPEG_HAS_SEND_RECEIVE                                    1
+#endif
+// av_bsf_* 从 lavc 57.38.100 开始有，之前只有 av_bitstream_filter_*
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 38, 100)
+#define LIVE_FFMPEG_HAS_BSF                                             1
+#endif
+
 #endif	// PLATFORM_4_LIVE_FFMPEG
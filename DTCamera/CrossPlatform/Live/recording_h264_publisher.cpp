@@ -7,7 +7,6 @@
 //
 
 #include "recording_h264_publisher.h"
-#define is_start_code(code) (((code) & 0x0ffffff) == 0x01)
 
 RecordingH264Publisher::RecordingH264Publisher() {
     headerData = NULL;
@@ -22,71 +21,26 @@ double RecordingH264Publisher::getVideoStreamTimeInSecs() {
     return lastPresentationTimeMs / 1000.0f;
 }
 
-uint32_t RecordingH264Publisher::findStartCode(uint8_t *in_pBuffer, uint32_t in_ui32BufferSize, uint32_t in_ui32Code, uint32_t &out_ui32ProcessedBytes) {
-    uint32_t ui32Code = in_ui32Code;
-    
-    const uint8_t *ptr = in_pBuffer;
-    while (ptr < in_pBuffer + in_ui32BufferSize) {
-        ui32Code = *ptr++ + (ui32Code << 8);
-        if (is_start_code(ui32Code)) {
-            break;
+bool RecordingH264Publisher::findParameterSet(int naluType, int codec, uint8_t **nalu, int *naluSize) {
+    LiveNALUnit units[LIVE_NAL_MAX_UNITS];
+    int count = LiveNALParser::split(headerData, headerSize, units, LIVE_NAL_MAX_UNITS);
+    for (int i = 0; i < count; i++) {
+        if (LiveNALParser::getNALUType(headerData + units[i].offset, codec) == naluType) {
+            *nalu = headerData + units[i].offset;
+            *naluSize = units[i].size;
+            return true;
         }
     }
-    
-    out_ui32ProcessedBytes = (uint32_t)(ptr - in_pBuffer);
-    return ui32Code;
-}
-
-void RecordingH264Publisher::parseH264SequenceHeader(uint8_t *in_pBuffer, uint32_t in_ui32Size, uint8_t **inout_pBufferSPS, int &inout_ui32sizeSPS, uint8_t **inout_pBufferPPS, int &inout_ui32sizePPS) {
-    uint32_t ui32StartCode = 0x0ff;
-    
-    uint8_t *pBuffer = in_pBuffer;
-    uint32_t ui32BufferSize = in_ui32Size;
-    
-    uint32_t sps = 0;
-    uint32_t pps = 0;
-    
-    uint32_t idr = in_ui32Size;
-    
-    do {
-        uint32_t ui32ProcessedBytes = 0;
-        ui32StartCode = findStartCode(pBuffer, ui32BufferSize, ui32StartCode, ui32ProcessedBytes);
-        pBuffer += ui32ProcessedBytes;
-        ui32BufferSize -= ui32ProcessedBytes;
-        
-        if (ui32BufferSize < 1) {
-            break;
-        }
-        
-        uint8_t val = (*pBuffer & 0x1f);
-        
-        if (val == 5) {
-            idr = pps + ui32ProcessedBytes - 4;
-        }
-        if (val == 7) {
-            sps = ui32ProcessedBytes;
-        }
-        if (val == 8) {
-            pps = sps + ui32ProcessedBytes;
-        }
-    } while (ui32BufferSize > 0);
-    
-    *inout_pBufferSPS = in_pBuffer + sps - 4;
-    inout_ui32sizeSPS = pps - sps;
-    
-    *inout_pBufferPPS = in_pBuffer + pps - 4;
-    inout_ui32sizePPS = idr - pps + 4;
+    return false;
 }
 
-int RecordingH264Publisher::write_video_frame(AVFormatContext *oc, AVStream *st) {
+int RecordingH264Publisher::write_video_frame(AVFormatContext *oc, AVStream *st, LiveVideoPacket *h264Packet) {
     int ret = 0;
     AVCodecContext *c = st->codec;
     
-    // 调用注册的回调方法来拿到我们的 h264 的 EncodedData
-    LiveVideoPacket *h264Packet = NULL;
-    fillH264PacketCallback(&h264Packet, fillH264PacketContext);
+    // h264Packet 是发送循环从队列里批量取出的 EncodedData
     if (h264Packet == NULL) {
-        printf("fillH264PacketCallback get null packet\n");
+        printf("write_video_frame get null packet\n");
         return VIDEO_QUEUE_ABORT_ERR_CODE;
     }
     int bufferSize = (h264Packet)->size;
@@ -100,95 +54,37 @@ int RecordingH264Publisher::write_video_frame(AVFormatContext *oc, AVStream *st)
     int64_t cal_pts = lastPresentationTimeMs / 1000.0f / av_q2d(video_st->time_base);
     int64_t pts = h264Packet->pts == PTS_PARAM_UN_SETTIED_FLAG ? cal_pts : h264Packet->pts;
     int64_t dts = h264Packet->dts == DTS_PARAM_UN_SETTIED_FLAG ? pts : h264Packet->dts == DTS_PARAM_NOT_A_NUM_FLAG ? AV_NOPTS_VALUE : h264Packet->dts;
-    int nalu_type = (outputData[4] & 0x1F);
+    int nalu_type = h264Packet->getNALUType();
     if (nalu_type == H264_NALU_TYPE_SEQUENCE_PARAMETER_SET) {
-        // 我们这里要求 sps 和 pps 一块拼接起来构造成 AVPacket 传过来
+        // sps 和 pps 按 AVCC 格式拼在一个包里传过来，只用来生成 avcC，缓存下来重连时还要再写一次头
+        if (NULL != headerData) {
+            delete[] headerData;
+        }
         headerSize = bufferSize;
         headerData = new uint8_t[headerSize];
         memcpy(headerData, outputData, bufferSize);
-        
-        uint8_t *spsFrame = 0;
-        uint8_t *ppsFrame = 0;
-        
-        int spsFrameLen = 0;
-        int ppsFrameLen = 0;
-        
-        parseH264SequenceHeader(headerData, headerSize, &spsFrame, spsFrameLen, &ppsFrame, ppsFrameLen);
-        
-        // 将 SPS 和 PPS 封装到视频编码器上下文的 extradata 中，参考 FFmpeg 源码中 avc.c
-        int extradata_len = 8 + spsFrameLen - 4 + 1 + 2 + ppsFrameLen - 4;
-        c->extradata = (uint8_t *)av_mallocz(extradata_len);
-        c->extradata_size = extradata_len;
-        c->extradata[0] = 0x01; // version
-        c->extradata[1] = spsFrame[4 + 1];  // profile
-        c->extradata[2] = spsFrame[4 + 2];  // profile compat
-        c->extradata[3] = spsFrame[4 + 3];  // level
-        c->extradata[4] = 0xFC | 3; // 保留位
-        c->extradata[5] = 0xE0 | 1; // 保留位
-        int tmp = spsFrameLen - 4; // 开始写 SPS
-        c->extradata[6] = (tmp >> 8) & 0x00ff;
-        c->extradata[7] = tmp & 0x00ff;
-        int i = 0;
-        for (i = 0; i < tmp; i++) {
-            c->extradata[8 + i] = spsFrame[4 + i];
-        }
-        c->extradata[8 + tmp] = 0x01; // 结束写 SPS
-        int tmp2 = ppsFrameLen - 4; // 开始写 PPS
-        c->extradata[8 + tmp + 1] = (tmp2 >> 8) & 0x00ff;
-        c->extradata[8 + tmp + 2] = tmp2 & 0x00ff;
-        for (i = 0; i < tmp2; i++) {
-            c->extradata[8 + tmp + 3 + i] = ppsFrame[4 + i];
-        }
-        // 结束写 PPS
-        
-        int ret = avformat_write_header(oc, NULL);
-        if (ret < 0) {
-            printf("Error occurred when opening output file: %s\n", av_err2str(ret));
-        } else {
-            isWriteHeaderSuccess = true;
+        // 同一个连接上头只能写一次，后面再来的 SPS/PPS 只更新缓存
+        if (!isWriteHeaderSuccess) {
+            ret = write_header(oc, st);
         }
     } else {
+        // 起始码格式的包换成 4 字节长度前缀，一个包里可以有 SEI + slice 或者多个 slice
+        // 编码数据被其他包共享时先复制一份，不改动别人看到的数据
+        if (!h264Packet->convertToAVCC()) {
+            printf("write_video_frame drop packet without NAL, size %d\n", bufferSize);
+            delete h264Packet;
+            return 0;
+        }
+        pkt.size = h264Packet->size;
+        pkt.data = (uint8_t *)(h264Packet->buffer);
+        pkt.pts = pts;
+        pkt.dts = dts;
         if (nalu_type == H264_NALU_TYPE_IDR_PICTURE || nalu_type == H264_NALU_TYPE_SEI) {
-            pkt.size = bufferSize;
-            pkt.data = outputData;
-            
-            if (pkt.data[0] == 0x00 && pkt.data[1] == 0x00 &&
-                pkt.data[2] == 0x00 && pkt.data[3] == 0x01) {
-                bufferSize -= 4;
-                pkt.data[0] = ((bufferSize) >> 24) & 0x00ff;
-                pkt.data[1] = ((bufferSize) >> 16) & 0x00ff;
-                pkt.data[2] = ((bufferSize) >> 8) & 0x00ff;
-                pkt.data[3] = ((bufferSize)) & 0x00ff;
-                
-//                printf("write_video_frame %d %d %x %x %x %x\n", nalu_type, bufferSize,
-//                       pkt.data[0], pkt.data[1], pkt.data[2], pkt.data[3]);
-
-                pkt.pts = pts;
-                pkt.dts = dts;
-                pkt.flags = AV_PKT_FLAG_KEY; // 标识为关键帧
-                c->frame_number++;
-            }
+            pkt.flags = AV_PKT_FLAG_KEY; // 标识为关键帧
         } else {
-            pkt.size = bufferSize;
-            pkt.data = outputData;
-            
-            if (pkt.data[0] == 0x00 && pkt.data[1] == 0x00 &&
-                pkt.data[2] == 0x00 && pkt.data[3] == 0x01) {
-                bufferSize -= 4;
-                pkt.data[0] = ((bufferSize) >> 24) & 0x00ff;
-                pkt.data[1] = ((bufferSize) >> 16) & 0x00ff;
-                pkt.data[2] = ((bufferSize) >> 8) & 0x00ff;
-                pkt.data[3] = ((bufferSize)) & 0x00ff;
-                
-//                printf("write_video_frame %d %d %x %x %x %x\n", nalu_type, bufferSize,
-//                       pkt.data[0], pkt.data[1], pkt.data[2], pkt.data[3]);
-
-                pkt.pts = pts;
-                pkt.dts = dts;
-                pkt.flags = 0; // 标识为不是关键帧
-                c->frame_number++;
-            }
+            pkt.flags = 0; // 标识为不是关键帧
         }
+        c->frame_number++;
         // 写出数据
         if (pkt.size) {
             ret = RecordingPublisher::interleavedWriteFrame(oc, &pkt);
@@ -203,6 +99,45 @@ int RecordingH264Publisher::write_video_frame(AVFormatContext *oc, AVStream *st)
     return ret;
 }
 
+int RecordingH264Publisher::write_header(AVFormatContext *oc, AVStream *st) {
+    AVCodecContext *c = st->codec;
+    uint8_t *sps = NULL;
+    uint8_t *pps = NULL;
+    int spsSize = 0;
+    int ppsSize = 0;
+    if (!findParameterSet(H264_NALU_TYPE_SEQUENCE_PARAMETER_SET, LIVE_VIDEO_CODEC_H264, &sps, &spsSize) ||
+        !findParameterSet(H264_NALU_TYPE_PICTURE_PARAMETER_SET, LIVE_VIDEO_CODEC_H264, &pps, &ppsSize) ||
+        spsSize < 4) {
+        printf("RecordingH264Publisher sequence header miss SPS/PPS\n");
+        return -1;
+    }
+    
+    // 将 SPS 和 PPS 按 AVCDecoderConfigurationRecord（avcC）封装到 extradata 中，参考 FFmpeg 源码中 avc.c
+    // 帧数据是 4 字节长度前缀，lengthSizeMinusOne 写 3
+    int extradata_len = 8 + spsSize + 1 + 2 + ppsSize;
+    av_freep(&c->extradata);
+    c->extradata = (uint8_t *)av_mallocz(extradata_len);
+    c->extradata_size = extradata_len;
+    c->extradata[0] = 0x01; // version
+    c->extradata[1] = sps[1];  // profile
+    c->extradata[2] = sps[2];  // profile compat
+    c->extradata[3] = sps[3];  // level
+    c->extradata[4] = 0xFC | 3; // 保留位
+    c->extradata[5] = 0xE0 | 1; // 保留位
+    // 开始写 SPS
+    c->extradata[6] = (spsSize >> 8) & 0x00ff;
+    c->extradata[7] = spsSize & 0x00ff;
+    memcpy(c->extradata + 8, sps, spsSize);
+    c->extradata[8 + spsSize] = 0x01; // 结束写 SPS
+    // 开始写 PPS
+    c->extradata[8 + spsSize + 1] = (ppsSize >> 8) & 0x00ff;
+    c->extradata[8 + spsSize + 2] = ppsSize & 0x00ff;
+    memcpy(c->extradata + 8 + spsSize + 3, pps, ppsSize);
+    // 结束写 PPS
+    
+    return RecordingPublisher::write_header(oc, st);
+}
+
 int RecordingH264Publisher::stop() {
     int ret = RecordingPublisher::stop();
     if (headerData) {
@@ -22,15 +22,12 @@ public:
 protected:
     int lastPresentationTimeMs;
     
-    virtual int write_video_frame(AVFormatContext *oc, AVStream *st);
+    virtual int write_video_frame(AVFormatContext *oc, AVStream *st, LiveVideoPacket *h264Packet);
+    virtual int write_header(AVFormatContext *oc, AVStream *st);
     virtual double getVideoStreamTimeInSecs();
     
-    uint32_t findStartCode(uint8_t *in_pBuffer, uint32_t in_ui32BufferSize,
-                           uint32_t in_ui32Code, uint32_t& out_ui32ProcessedBytes);
-    
-    void parseH264SequenceHeader(uint8_t *in_pBuffer, uint32_t in_ui32Size,
-                                 uint8_t **inout_pBufferSPS, int &inout_ui32sizeSPS,
-                                 uint8_t **inout_pBufferPPS, int &inout_ui32sizePPS);
+    /* 在 headerData 里找到 naluType 类型的参数集，返回不带长度前缀 / 起始码的数据 */
+    bool findParameterSet(int naluType, int codec, uint8_t **nalu, int *naluSize);
 };
 
 #endif /* recording_h264_publisher_h */
@@ -0,0 +1,240 @@
+//
+//  recording_hevc_publisher.cpp
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#include "recording_hevc_publisher.h"
+
+/** 按位读 RBSP，读过头时返回 0 并置 overflow **/
+typedef struct LiveBitReader {
+    const uint8_t *data;
+    int size;
+    int bitOffset;
+    bool overflow;
+} LiveBitReader;
+
+static uint32_t readBits(LiveBitReader *reader, int count) {
+    uint32_t value = 0;
+    for (int i = 0; i < count; i++) {
+        if (reader->bitOffset >= reader->size * 8) {
+            reader->overflow = true;
+            return 0;
+        }
+        int bit = (reader->data[reader->bitOffset >> 3] >> (7 - (reader->bitOffset & 7))) & 0x01;
+        value = (value << 1) | bit;
+        reader->bitOffset++;
+    }
+    return value;
+}
+
+static void skipBits(LiveBitReader *reader, int count) {
+    reader->bitOffset += count;
+    if (reader->bitOffset > reader->size * 8) {
+        reader->overflow = true;
+    }
+}
+
+/* 无符号指数哥伦布码 */
+static uint32_t readUE(LiveBitReader *reader) {
+    int leadingZeroBits = 0;
+    while (!reader->overflow && readBits(reader, 1) == 0) {
+        leadingZeroBits++;
+        if (leadingZeroBits > 31) {
+            reader->overflow = true;
+            return 0;
+        }
+    }
+    return ((1u << leadingZeroBits) - 1) + readBits(reader, leadingZeroBits);
+}
+
+RecordingHEVCPublisher::RecordingHEVCPublisher() {
+}
+
+RecordingHEVCPublisher::~RecordingHEVCPublisher() {
+}
+
+enum AVCodecID RecordingHEVCPublisher::getVideoCodecId() {
+    return AV_CODEC_ID_HEVC;
+}
+
+int RecordingHEVCPublisher::parseSPS(uint8_t *sps, int spsSize, LiveHEVCSPSInfo *info) {
+    uint8_t rbsp[HEVC_MAX_PARAMETER_SET_SIZE];
+    LiveBitReader reader;
+    reader.data = rbsp;
+    reader.size = LiveNALParser::unescapeRBSP(sps, MIN(spsSize, HEVC_MAX_PARAMETER_SET_SIZE), rbsp);
+    reader.bitOffset = 0;
+    reader.overflow = false;
+    
+    skipBits(&reader, 4); // sps_video_parameter_set_id
+    info->maxSubLayersMinus1 = readBits(&reader, 3);
+    info->temporalIdNestingFlag = readBits(&reader, 1);
+    // profile_tier_level 的 general 部分
+    info->profileSpace = readBits(&reader, 2);
+    info->tierFlag = readBits(&reader, 1);
+    info->profileIdc = readBits(&reader, 5);
+    info->profileCompatibilityFlags = readBits(&reader, 32);
+    info->constraintIndicatorFlags = ((uint64_t)readBits(&reader, 16) << 32) | readBits(&reader, 32);
+    info->levelIdc = readBits(&reader, 8);
+    // 子层的 profile / level 不需要，跳过
+    int subLayerProfilePresent[8] = {0};
+    int subLayerLevelPresent[8] = {0};
+    for (int i = 0; i < info->maxSubLayersMinus1; i++) {
+        subLayerProfilePresent[i] = readBits(&reader, 1);
+        subLayerLevelPresent[i] = readBits(&reader, 1);
+    }
+    if (info->maxSubLayersMinus1 > 0) {
+        skipBits(&reader, 2 * (8 - info->maxSubLayersMinus1));
+    }
+    for (int i = 0; i < info->maxSubLayersMinus1; i++) {
+        if (subLayerProfilePresent[i]) {
+            skipBits(&reader, 88);
+        }
+        if (subLayerLevelPresent[i]) {
+            skipBits(&reader, 8);
+        }
+    }
+    readUE(&reader); // sps_seq_parameter_set_id
+    info->chromaFormatIdc = readUE(&reader);
+    if (3 == info->chromaFormatIdc) {
+        skipBits(&reader, 1); // separate_colour_plane_flag
+    }
+    readUE(&reader); // pic_width_in_luma_samples
+    readUE(&reader); // pic_height_in_luma_samples
+    if (readBits(&reader, 1)) { // conformance_window_flag
+        for (int i = 0; i < 4; i++) {
+            readUE(&reader);
+        }
+    }
+    info->bitDepthLumaMinus8 = readUE(&reader);
+    info->bitDepthChromaMinus8 = readUE(&reader);
+    return reader.overflow ? -1 : 0;
+}
+
+int RecordingHEVCPublisher::write_header(AVFormatContext *oc, AVStream *st) {
+    AVCodecContext *c = st->codec;
+    uint8_t *vps = NULL;
+    uint8_t *sps = NULL;
+    uint8_t *pps = NULL;
+    int vpsSize = 0;
+    int spsSize = 0;
+    int ppsSize = 0;
+    if (!findParameterSet(HEVC_NALU_TYPE_VPS, LIVE_VIDEO_CODEC_HEVC, &vps, &vpsSize) ||
+        !findParameterSet(HEVC_NALU_TYPE_SPS, LIVE_VIDEO_CODEC_HEVC, &sps, &spsSize) ||
+        !findParameterSet(HEVC_NALU_TYPE_PPS, LIVE_VIDEO_CODEC_HEVC, &pps, &ppsSize)) {
+        printf("RecordingHEVCPublisher sequence header miss VPS/SPS/PPS\n");
+        return -1;
+    }
+    LiveHEVCSPSInfo info;
+    // 跳过 2 字节的 NAL 头
+    if (spsSize <= 2 || parseSPS(sps + 2, spsSize - 2, &info) < 0) {
+        printf("RecordingHEVCPublisher parse SPS failed\n");
+        return -1;
+    }
+    
+    // 按照 ISO/IEC 14496-15 的 HEVCDecoderConfigurationRecord 生成 hvcC，参考 FFmpeg 源码中 hevc.c
+    int extradata_len = HEVC_DECODER_CONFIGURATION_HEADER_SIZE + 3 * 5 + vpsSize + spsSize + ppsSize;
+    av_freep(&c->extradata);
+    c->extradata = (uint8_t *)av_mallocz(extradata_len);
+    c->extradata_size = extradata_len;
+    uint8_t *p = c->extradata;
+    *p++ = 0x01; // configurationVersion
+    *p++ = (info.profileSpace << 6) | (info.tierFlag << 5) | info.profileIdc;
+    *p++ = (info.profileCompatibilityFlags >> 24) & 0xff;
+    *p++ = (info.profileCompatibilityFlags >> 16) & 0xff;
+    *p++ = (info.profileCompatibilityFlags >> 8) & 0xff;
+    *p++ = info.profileCompatibilityFlags & 0xff;
+    for (int shift = 40; shift >= 0; shift -= 8) {
+        *p++ = (info.constraintIndicatorFlags >> shift) & 0xff;
+    }
+    *p++ = info.levelIdc;
+    *p++ = 0xF0; // 保留位 + min_spatial_segmentation_idc
+    *p++ = 0x00;
+    *p++ = 0xFC; // 保留位 + parallelismType
+    *p++ = 0xFC | info.chromaFormatIdc;
+    *p++ = 0xF8 | info.bitDepthLumaMinus8;
+    *p++ = 0xF8 | info.bitDepthChromaMinus8;
+    *p++ = 0x00; // avgFrameRate
+    *p++ = 0x00;
+    // constantFrameRate = 0, numTemporalLayers, temporalIdNested, lengthSizeMinusOne = 3
+    *p++ = ((info.maxSubLayersMinus1 + 1) << 3) | (info.temporalIdNestingFlag << 2) | 0x03;
+    *p++ = 3; // numOfArrays
+    uint8_t *nalus[3] = {vps, sps, pps};
+    int naluSizes[3] = {vpsSize, spsSize, ppsSize};
+    int naluTypes[3] = {HEVC_NALU_TYPE_VPS, HEVC_NALU_TYPE_SPS, HEVC_NALU_TYPE_PPS};
+    for (int i = 0; i < 3; i++) {
+        *p++ = 0x80 | naluTypes[i]; // array_completeness = 1
+        *p++ = 0x00; // numNalus = 1
+        *p++ = 0x01;
+        *p++ = (naluSizes[i] >> 8) & 0xff;
+        *p++ = naluSizes[i] & 0xff;
+        memcpy(p, nalus[i], naluSizes[i]);
+        p += naluSizes[i];
+    }
+    // MP4 里用 hvc1，参数集只放在 hvcC 里，苹果的播放器只认这个
+    if (NULL != strstr(oc->oformat->name, "mp4") || NULL != strstr(oc->oformat->name, "mov")) {
+        c->codec_tag = MKTAG('h', 'v', 'c', '1');
+    }
+    return RecordingPublisher::write_header(oc, st);
+}
+
+int RecordingHEVCPublisher::write_video_frame(AVFormatContext *oc, AVStream *st, LiveVideoPacket *hevcPacket) {
+    int ret = 0;
+    AVCodecContext *c = st->codec;
+    
+    if (hevcPacket == NULL) {
+        printf("write_video_frame get null packet\n");
+        return VIDEO_QUEUE_ABORT_ERR_CODE;
+    }
+    int bufferSize = hevcPacket->size;
+    uint8_t *outputData = (uint8_t *)(hevcPacket->buffer);
+    
+    lastPresentationTimeMs = hevcPacket->timeMills;
+    AVPacket pkt = { 0 };
+    av_init_packet(&pkt);
+    pkt.stream_index = st->index;
+    int64_t cal_pts = lastPresentationTimeMs / 1000.0f / av_q2d(video_st->time_base);
+    int64_t pts = hevcPacket->pts == PTS_PARAM_UN_SETTIED_FLAG ? cal_pts : hevcPacket->pts;
+    int64_t dts = hevcPacket->dts == DTS_PARAM_UN_SETTIED_FLAG ? pts : hevcPacket->dts == DTS_PARAM_NOT_A_NUM_FLAG ? AV_NOPTS_VALUE : hevcPacket->dts;
+    if (hevcPacket->getNALUType() == HEVC_NALU_TYPE_VPS) {
+        // VPS/SPS/PPS 按 AVCC 格式拼在一起作为一个包传过来，只用来生成 hvcC，缓存下来重连时还要再写一次头
+        if (NULL != headerData) {
+            delete[] headerData;
+        }
+        headerSize = bufferSize;
+        headerData = new uint8_t[headerSize];
+        memcpy(headerData, outputData, bufferSize);
+        // 同一个连接上头只能写一次，后面再来的参数集只更新缓存
+        if (!isWriteHeaderSuccess) {
+            ret = write_header(oc, st);
+        }
+    } else {
+        if (!hevcPacket->convertToAVCC()) {
+            printf("write_video_frame drop packet without NAL, size %d\n", bufferSize);
+            delete hevcPacket;
+            return 0;
+        }
+        pkt.size = hevcPacket->size;
+        pkt.data = (uint8_t *)(hevcPacket->buffer);
+        pkt.pts = pts;
+        pkt.dts = dts;
+        if (hevcPacket->isIDRFrame() || hevcPacket->getNALUType() == HEVC_NALU_TYPE_PREFIX_SEI) {
+            pkt.flags = AV_PKT_FLAG_KEY;
+        } else {
+            pkt.flags = 0;
+        }
+        c->frame_number++;
+        if (pkt.size) {
+            ret = RecordingPublisher::interleavedWriteFrame(oc, &pkt);
+            if (ret != 0) {
+                printf("Error while writing Video frame: %s\n", av_err2str(ret));
+            }
+        } else {
+            ret = 0;
+        }
+    }
+    delete hevcPacket;
+    return ret;
+}
@@ -0,0 +1,52 @@
+//
+//  recording_hevc_publisher.h
+//  DTCamera
+//
+//  Created by Dan Jiang on 2026/10/17.
+//  Copyright © 2026 Dan Thought Studio. All rights reserved.
+//
+
+#ifndef recording_hevc_publisher_h
+#define recording_hevc_publisher_h
+
+#include "recording_h264_publisher.h"
+
+#define HEVC_DECODER_CONFIGURATION_HEADER_SIZE                          23
+#define HEVC_MAX_PARAMETER_SET_SIZE                                     1024
+
+/** 生成 hvcC 需要的 SPS 字段 **/
+typedef struct LiveHEVCSPSInfo {
+    int profileSpace;
+    int tierFlag;
+    int profileIdc;
+    uint32_t profileCompatibilityFlags;
+    uint64_t constraintIndicatorFlags; // 48 位
+    int levelIdc;
+    int maxSubLayersMinus1;
+    int temporalIdNestingFlag;
+    int chromaFormatIdc;
+    int bitDepthLumaMinus8;
+    int bitDepthChromaMinus8;
+} LiveHEVCSPSInfo;
+
+/**
+ * HEVC 的发布者，和 H.264 的区别只在参数集和封装：
+ * 头是 VPS/SPS/PPS 用起始码拼在一起的一个包，据此生成 hvcC 写进 extradata
+ * 帧数据和 H.264 一样，起始码格式的换成 4 字节长度前缀，IRAP 标记为关键帧
+ * 封装到 MP4 时用 hvc1，RTMP 需要 FFmpeg 的 flv 封装支持 enhanced-FLV
+ */
+class RecordingHEVCPublisher: public RecordingH264Publisher {
+public:
+    RecordingHEVCPublisher();
+    virtual ~RecordingHEVCPublisher();
+    
+    /* 从去掉 NAL 头的 SPS 里解析出生成 hvcC 需要的字段，成功返回 0 */
+    static int parseSPS(uint8_t *sps, int spsSize, LiveHEVCSPSInfo *info);
+    
+protected:
+    virtual enum AVCodecID getVideoCodecId();
+    virtual int write_video_frame(AVFormatContext *oc, AVStream *st, LiveVideoPacket *hevcPacket);
+    virtual int write_header(AVFormatContext *oc, AVStream *st);
+};
+
+#endif /* recording_hevc_publisher_h */
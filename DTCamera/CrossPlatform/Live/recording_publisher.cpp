@@ -8,6 +8,14 @@
 
 #include "recording_publisher.h"
 
+static pthread_once_t ffmpegRegisterOnce = PTHREAD_ONCE_INIT;
+
+static void registerFFmpeg() {
+    avcodec_register_all();
+    av_register_all();
+    avformat_network_init();
+}
+
 RecordingPublisher::RecordingPublisher() {
     isConnected = false;
     isWriteHeaderSuccess = false;
@@ -15,12 +23,49 @@ RecordingPublisher::RecordingPublisher() {
     audio_st = NULL;
     bsfc = NULL;
     oc = NULL;
+    networkContext = NULL;
+    ioWriter = NULL;
+    bitrateController = NULL;
+    packetNotifier = NULL;
     publishTimeout = 0;
+    packetPool = NULL;
+    headerData = NULL;
+    headerSize = 0;
+    videoOutputURI = NULL;
+    audioCodecName = NULL;
+    isReconnecting = false;
+    isWaitingForKeyFrame = false;
+    resumeTimeMills = 0;
+    reconnectCount = 0;
+    reconnectSkippedVideoFrames = 0;
+    pthread_mutex_init(&reconnectLock, NULL);
+    platform_4_live::initMonotonicCondition(&reconnectCondition);
     lastAudioPacketPresentationTimeMills = 0;
+    audioBatchCount = 0;
+    audioBatchIndex = 0;
+    videoBatchCount = 0;
+    videoBatchIndex = 0;
 }
 
 RecordingPublisher::~RecordingPublisher() {
     publishTimeout = 0;
+    if (NULL != videoOutputURI) {
+        free(videoOutputURI);
+        videoOutputURI = NULL;
+    }
+    if (NULL != audioCodecName) {
+        free(audioCodecName);
+        audioCodecName = NULL;
+    }
+    pthread_mutex_destroy(&reconnectLock);
+    pthread_cond_destroy(&reconnectCondition);
+}
+
+void RecordingPublisher::interruptPublisherPipe() {
+    pthread_mutex_lock(&reconnectLock);
+    this->publishTimeout = PUBLISH_INVALID_FLAG;
+    pthread_cond_broadcast(&reconnectCondition);
+    pthread_mutex_unlock(&reconnectLock);
 }
 
 void RecordingPublisher::registerPublishTimeoutCallback(int (*on_publish_timeout_callback)(void *), void *context) {
@@ -28,19 +73,39 @@ void RecordingPublisher::registerPublishTimeoutCallback(int (*on_publish_timeout
     this->timeoutContext = context;
 }
 
-void RecordingPublisher::registerFillAACPacketCallback(int (*fill_aac_packet_callback)(LiveAudioPacket **, void *), void *context) {
+void RecordingPublisher::setPacketNotifier(LivePacketNotifier *notifier) {
+    this->packetNotifier = notifier;
+}
+
+void RecordingPublisher::setBitrateController(LiveBitrateController *controller) {
+    this->bitrateController = controller;
+}
+
+void RecordingPublisher::registerFillAACPacketCallback(int (*fill_aac_packet_callback)(LiveAudioPacket **, int, int, void *), void *context) {
     this->fillAACPacketCallback = fill_aac_packet_callback;
     this->fillAACPacketContext = context;
 }
 
-void RecordingPublisher::registerFillVideoPacketCallback(int (*fill_packet_frame)(LiveVideoPacket **, void *), void *context) {
+void RecordingPublisher::registerFillVideoPacketCallback(int (*fill_packet_frame)(LiveVideoPacket **, int, int, void *), void *context) {
     this->fillH264PacketCallback = fill_packet_frame;
     this->fillH264PacketContext = context;
 }
 
 int RecordingPublisher::detectTimeout() {
-    if (platform_4_live::getCurrentTimeMills() - sendLatestFrameTimemills > publishTimeout) {
-        int queueSize = LivePacketPool::GetInstance()->getRecordingVideoPacketQueueSize();
+    int64_t waitMills = 0;
+    int64_t timeoutMills = publishTimeout;
+    if (NULL != ioWriter) {
+        // 发送已经交给 I/O 线程，按这一次网络写阻塞的时间判断
+        waitMills = ioWriter->getCurrentStallMills();
+    } else {
+        // 连接阶段，重连时每次尝试从 sendLatestFrameTimemills 开始计时
+        waitMills = platform_4_live::getMonotonicTimeMills() - sendLatestFrameTimemills;
+        if (isReconnecting && !isInterrupted()) {
+            timeoutMills = PUBLISH_RECONNECT_ATTEMPT_TIMEOUT_MILLS;
+        }
+    }
+    if (waitMills > timeoutMills) {
+        int queueSize = NULL != packetPool ? packetPool->getRecordingVideoPacketQueueSize() : 0;
         printf("RecordingPublisher::interrupt_cb callback time out ... queue size:%d\n", queueSize);
         return 1; // 返回 1 则代表结束 I/O 操作
     }
@@ -52,10 +117,14 @@ int RecordingPublisher::interrupt_cb(void *ctx) { // 超时回调函数
     return publisher->detectTimeout();
 }
 
-int RecordingPublisher::init(char *videoOutputURI, int videoWidth, int videoHeight, int videoFrameRate, int videoBitRate, int audioSampleRate, int audioChannels, int audioBitRate, char *audioCodecName) {
-    int ret = 0;
+int RecordingPublisher::init(LivePacketPool *packetPool, char *videoOutputURI, int videoWidth, int videoHeight, int videoFrameRate, int videoBitRate, int audioSampleRate, int audioChannels, int audioBitRate, char *audioCodecName) {
+    this->packetPool = packetPool;
     this->publishTimeout = PUBLISH_DATA_TIME_OUT;
-    this->sendLatestFrameTimemills = platform_4_live::getCurrentTimeMills();
+    this->sendLatestFrameTimemills = platform_4_live::getMonotonicTimeMills();
+    this->lastStatsTimeMills = this->sendLatestFrameTimemills;
+    this->lastBitrateUpdateTimeMills = this->sendLatestFrameTimemills;
+    this->lastAudioArrivalMills = this->sendLatestFrameTimemills;
+    this->lastVideoArrivalMills = this->sendLatestFrameTimemills;
     this->duration = 0.0;
     this->isConnected = false;
     this->onPublishTimeoutCallback = NULL;
@@ -68,18 +137,36 @@ int RecordingPublisher::init(char *videoOutputURI, int videoWidth, int videoHeig
     this->audioSampleRate = audioSampleRate;
     this->audioChannels = audioChannels;
     this->audioBitRate = audioBitRate;
+    // 重连时要用同样的参数重新打开
+    this->videoOutputURI = strdup(videoOutputURI);
+    this->audioCodecName = strdup(audioCodecName);
     
-    avcodec_register_all();
-    av_register_all();
-    avformat_network_init();
+    // 多个会话可能同时在各自的线程里 init，全局注册只做一次
+    pthread_once(&ffmpegRegisterOnce, registerFFmpeg);
     
     printf("Publish URL %s\n", videoOutputURI);
+    return openOutput();
+}
+
+bool RecordingPublisher::isNetworkOutput() {
+    return strncmp(videoOutputURI, "rtmp", 4) == 0;
+}
 
-    avformat_alloc_output_context2(&oc, NULL, "flv", videoOutputURI);
+int RecordingPublisher::openOutput() {
+    int ret = 0;
+
+    // rtmp 推流用 flv，本地文件按扩展名选择封装格式（.flv / .mp4）
+    const char *formatName = isNetworkOutput() ? "flv" : NULL;
+    avformat_alloc_output_context2(&oc, NULL, formatName, videoOutputURI);
     if (!oc) {
         return -1;
     }
     fmt = oc->oformat;
+    // 老版本的 flv 封装不认识 HEVC，需要支持 enhanced-FLV 的 FFmpeg
+    if (AV_CODEC_ID_H264 != getVideoCodecId() && avformat_query_codec(fmt, getVideoCodecId(), FF_COMPLIANCE_NORMAL) == 0) {
+        printf("%s can not mux %s\n", fmt->name, avcodec_get_name(getVideoCodecId()));
+        return -1;
+    }
     
     if ((ret = buildVideoStream()) < 0) {
         printf("buildVideoStream failed....\n");
@@ -95,11 +182,20 @@ int RecordingPublisher::init(char *videoOutputURI, int videoWidth, int videoHeig
         if (PUBLISH_INVALID_FLAG != this->publishTimeout) {
             AVIOInterruptCB int_cb = {interrupt_cb, this};
             oc->interrupt_callback = int_cb;
-            ret = avio_open2(&oc->pb, videoOutputURI, AVIO_FLAG_WRITE, &oc->interrupt_callback, NULL);
+            ret = avio_open2(&networkContext, videoOutputURI, AVIO_FLAG_WRITE, &oc->interrupt_callback, NULL);
             if (ret < 0) {
                 printf("Could not open '%s': %s\n", videoOutputURI, av_err2str(ret));
                 return -1;
             }
+            if (isNetworkOutput()) {
+                // muxer 写进 ioWriter 的字节队列，由 ioWriter 的线程发到网络上，等空间最多等到发布超时
+                ioWriter = new LiveIOWriter(networkContext, IO_WRITER_QUEUE_CAPACITY, publishTimeout);
+                oc->pb = ioWriter->getMuxContext();
+                ioWriter->startAsync();
+            } else {
+                // 本地文件直接写，mp4 的 moov 和 flv 的时长、文件大小要在结束时 seek 回去改
+                oc->pb = networkContext;
+            }
             this->isConnected = true;
         } else {
             return -1;
@@ -111,20 +207,162 @@ int RecordingPublisher::init(char *videoOutputURI, int videoWidth, int videoHeig
     return 1;
 }
 
+int RecordingPublisher::fillAudioBatch(int maxWaitMills) {
+    int ret = fillAACPacketCallback(audioBatch, PUBLISH_PACKET_BATCH_SIZE, maxWaitMills, fillAACPacketContext);
+    audioBatchIndex = 0;
+    audioBatchCount = MAX(ret, 0);
+    if (ret > 0) {
+        lastAudioArrivalMills = platform_4_live::getMonotonicTimeMills();
+    }
+    return ret < 0 ? AUDIO_QUEUE_ABORT_ERR_CODE : ret;
+}
+
+int RecordingPublisher::fillVideoBatch(int maxWaitMills) {
+    int ret = fillH264PacketCallback(videoBatch, PUBLISH_PACKET_BATCH_SIZE, maxWaitMills, fillH264PacketContext);
+    videoBatchIndex = 0;
+    videoBatchCount = MAX(ret, 0);
+    if (ret > 0) {
+        lastVideoArrivalMills = platform_4_live::getMonotonicTimeMills();
+    }
+    return ret < 0 ? VIDEO_QUEUE_ABORT_ERR_CODE : ret;
+}
+
+int RecordingPublisher::refillBatches() {
+    int ret = 0;
+    if (NULL != audio_st && audioBatchIndex >= audioBatchCount && (ret = fillAudioBatch(0)) < 0) {
+        return ret;
+    }
+    if (NULL != video_st && videoBatchIndex >= videoBatchCount && (ret = fillVideoBatch(0)) < 0) {
+        return ret;
+    }
+    return 0;
+}
+
+int RecordingPublisher::chooseNextStream(int *maxWaitMills) {
+    bool hasAudio = NULL != audio_st && audioBatchIndex < audioBatchCount;
+    bool hasVideo = NULL != video_st && videoBatchIndex < videoBatchCount;
+    // 重连之后先找到 IDR，再去写音频
+    if (isWaitingForKeyFrame) {
+        return hasVideo ? PUBLISH_STREAM_VIDEO : PUBLISH_STREAM_NONE;
+    }
+    double audioTimeMills = hasAudio ? audioBatch[audioBatchIndex]->position : lastAudioPacketPresentationTimeMills;
+    double videoTimeMills = hasVideo ? videoBatch[videoBatchIndex]->timeMills : getVideoStreamTimeInSecs() * 1000.0;
+    // 两路都有包时按队头的时间戳交错写出，音视频是交错存储的，存储完一帧视频帧之后，再存储一段时间的音频
+    if (hasAudio && hasVideo) {
+        return audioTimeMills < videoTimeMills ? PUBLISH_STREAM_AUDIO : PUBLISH_STREAM_VIDEO;
+    }
+    if (!hasAudio && !hasVideo) {
+        return PUBLISH_STREAM_NONE;
+    }
+    // 只有一路有包：没有另一路的流，或者领先另一路不超过交错窗口，或者另一路已经断了，都直接写出
+    int stream = hasAudio ? PUBLISH_STREAM_AUDIO : PUBLISH_STREAM_VIDEO;
+    AVStream *otherStream = hasAudio ? video_st : audio_st;
+    double aheadMills = hasAudio ? audioTimeMills - videoTimeMills : videoTimeMills - audioTimeMills;
+    if (NULL == otherStream || aheadMills <= PUBLISH_INTERLEAVE_WINDOW_MILLS) {
+        return stream;
+    }
+    int64_t silentMills = platform_4_live::getMonotonicTimeMills() - (hasAudio ? lastVideoArrivalMills : lastAudioArrivalMills);
+    if (silentMills >= PUBLISH_STREAM_SILENT_MILLS) {
+        return stream;
+    }
+    *maxWaitMills = (int)MAX(PUBLISH_STREAM_SILENT_MILLS - silentMills, 1);
+    return PUBLISH_STREAM_NONE;
+}
+
+int RecordingPublisher::waitForPackets(int64_t sequence, int64_t deadlineMills) {
+    if (NULL != packetNotifier) {
+        return packetNotifier->waitUntil(sequence, deadlineMills);
+    }
+    // 没有共享的到达通知时只能阻塞在一个队列上，等还没有包的那一路
+    int remainMills = (int)MAX(deadlineMills - platform_4_live::getMonotonicTimeMills(), (int64_t)0);
+    int ret = 0;
+    if (NULL != video_st && videoBatchIndex >= videoBatchCount) {
+        ret = fillVideoBatch(remainMills);
+    } else if (NULL != audio_st && audioBatchIndex >= audioBatchCount) {
+        ret = fillAudioBatch(remainMills);
+    }
+    return ret > 0 ? 0 : ETIMEDOUT;
+}
+
+LiveVideoPacket *RecordingPublisher::takeVideoPacket() {
+    LiveVideoPacket *videoPacket = videoBatch[videoBatchIndex++];
+    // 离开批次之后就不再算在包池的队列预算里
+    if (NULL != packetPool) {
+        packetPool->releaseStagedVideoPacket(videoPacket);
+    }
+    return videoPacket;
+}
+
+void RecordingPublisher::releaseBatches() {
+    while (audioBatchIndex < audioBatchCount) {
+        delete audioBatch[audioBatchIndex++];
+    }
+    while (videoBatchIndex < videoBatchCount) {
+        LiveVideoPacket *videoPacket = takeVideoPacket();
+        delete videoPacket;
+    }
+}
+
 int RecordingPublisher::encode() {
     int ret = 0;
-    double video_time = getVideoStreamTimeInSecs();
-    double audio_time = getAudioStreamTimeInSecs();
-    printf("video_time is %lf, audio_time is %f\n", video_time, audio_time);
-    if (!video_st || (video_st && audio_st && audio_time < video_time)) { // 通过比较两路流上当前的时间戳信息，将时间戳比较小的那一路流进行封装和输出，音视频是交错存储的，即存储完一帧视频帧之后，再存储一段时间的音频，不一定是一帧音频，要看视频的 FPS 是多少
-        ret = write_audio_frame(oc, audio_st);
-    } else if (video_st) {
-        ret = write_video_frame(oc, video_st);
-    }
-    sendLatestFrameTimemills = platform_4_live::getCurrentTimeMills();
-    duration = MIN(audio_time, video_time);
+    int writeCount = 0;
+    int64_t deadlineMills = platform_4_live::getDeadlineMills(PUBLISH_PACKET_BATCH_MAX_WAIT_MILLS);
+    // 两路流各自取一批包，每次写出队头时间戳较小的那一个，一路流卡住不会挡住另一路；最多等 PUBLISH_PACKET_BATCH_MAX_WAIT_MILLS 就回去做心跳
+    for (;;) {
+        // 先记下通知的序号再检查队列，检查之后来的包一定会唤醒下面的等待
+        int64_t sequence = NULL != packetNotifier ? packetNotifier->getSequence() : 0;
+        if ((ret = refillBatches()) < 0) {
+            break;
+        }
+        int maxWaitMills = PUBLISH_PACKET_BATCH_MAX_WAIT_MILLS;
+        int stream = chooseNextStream(&maxWaitMills);
+        if (PUBLISH_STREAM_AUDIO == stream) {
+            LiveAudioPacket *audioPacket = audioBatch[audioBatchIndex++];
+            if (audioPacket->position < resumeTimeMills) {
+                delete audioPacket;
+                continue;
+            }
+            ret = write_audio_frame(oc, audio_st, audioPacket);
+        } else if (PUBLISH_STREAM_VIDEO == stream) {
+            LiveVideoPacket *videoPacket = takeVideoPacket();
+            if (isWaitingForKeyFrame) {
+                int priority = LiveVideoDropPolicy::classify(videoPacket);
+                if (VIDEO_FRAME_PRIORITY_KEY == priority) {
+                    isWaitingForKeyFrame = false;
+                    resumeTimeMills = videoPacket->timeMills;
+                    printf("RecordingPublisher resume at key frame %.0lf ms, skipped %lld video frames\n",
+                           resumeTimeMills, (long long)reconnectSkippedVideoFrames);
+                } else if (VIDEO_FRAME_PRIORITY_HEADER != priority) {
+                    reconnectSkippedVideoFrames++;
+                    delete videoPacket;
+                    continue;
+                }
+            }
+            ret = write_video_frame(oc, video_st, videoPacket);
+        } else {
+            // 没有能写的包：这一轮写过就回去做心跳，否则等任意一路来数据，或者等到另一路可以判定为断流
+            if (writeCount > 0) {
+                break;
+            }
+            int64_t waitDeadlineMills = MIN(deadlineMills, platform_4_live::getDeadlineMills(maxWaitMills));
+            if (ETIMEDOUT == waitForPackets(sequence, waitDeadlineMills) && waitDeadlineMills >= deadlineMills) {
+                break;
+            }
+            continue;
+        }
+        writeCount++;
+        sendLatestFrameTimemills = platform_4_live::getMonotonicTimeMills();
+        duration = MIN(getAudioStreamTimeInSecs(), getVideoStreamTimeInSecs());
+        if (ret < 0) {
+            break;
+        }
+    }
     if (ret < 0 && VIDEO_QUEUE_ABORT_ERR_CODE != ret && AUDIO_QUEUE_ABORT_ERR_CODE != ret && !isInterrupted()) {
-        if (NULL != onPublishTimeoutCallback) {
+        // 队列和编码器都不动，只重新建立连接；重连不上再通知上层
+        if (reconnect() >= 0) {
+            return 0;
+        }
+        if (!isInterrupted() && NULL != onPublishTimeoutCallback) {
             onPublishTimeoutCallback(timeoutContext);
         }
         this->isConnected = false;
@@ -132,14 +370,121 @@ int RecordingPublisher::encode() {
     return ret;
 }
 
+int RecordingPublisher::reconnect() {
+    if (!isNetworkOutput()) {
+        return -1;
+    }
+    printf("RecordingPublisher connection lost, reconnect to %s\n", videoOutputURI);
+    isReconnecting = true;
+    closeOutput(false);
+    int64_t startMills = platform_4_live::getMonotonicTimeMills();
+    int backoffMills = PUBLISH_RECONNECT_INITIAL_BACKOFF_MILLS;
+    int ret = -1;
+    for (int attempt = 1; !isInterrupted(); attempt++) {
+        sendLatestFrameTimemills = platform_4_live::getMonotonicTimeMills();
+        ret = openOutput();
+        if (ret >= 0 && NULL != headerData && NULL != video_st) {
+            // 编码器不会再发 SPS/PPS，用缓存的重新写头
+            ret = write_header(oc, video_st);
+        }
+        int64_t now = platform_4_live::getMonotonicTimeMills();
+        printf("RecordingPublisher reconnect attempt %d return %d after %lld ms\n", attempt, ret, (long long)(now - startMills));
+        if (ret >= 0) {
+            break;
+        }
+        closeOutput(false);
+        if (now - startMills + backoffMills > PUBLISH_RECONNECT_MAX_DURATION_MILLS) {
+            break;
+        }
+        pthread_mutex_lock(&reconnectLock);
+        int64_t deadlineMills = platform_4_live::getDeadlineMills(backoffMills);
+        while (!isInterrupted() &&
+               platform_4_live::waitConditionUntil(&reconnectCondition, &reconnectLock, deadlineMills) != ETIMEDOUT) {
+        }
+        pthread_mutex_unlock(&reconnectLock);
+        backoffMills = MIN(backoffMills * 2, PUBLISH_RECONNECT_MAX_BACKOFF_MILLS);
+    }
+    isReconnecting = false;
+    if (ret < 0 || isInterrupted()) {
+        printf("RecordingPublisher reconnect failed\n");
+        return -1;
+    }
+    reconnectCount++;
+    sendLatestFrameTimemills = platform_4_live::getMonotonicTimeMills();
+    // 断线期间积压的视频参考不到新连接上的 IDR，丢到下一个 IDR 为止
+    isWaitingForKeyFrame = NULL != video_st;
+    reconnectSkippedVideoFrames = 0;
+    // 重连期间没有去取包，不能因此判定另一路断流
+    lastAudioArrivalMills = sendLatestFrameTimemills;
+    lastVideoArrivalMills = sendLatestFrameTimemills;
+    return 0;
+}
+
+int RecordingPublisher::heartbeat() {
+    int64_t now = platform_4_live::getMonotonicTimeMills();
+    if (now - lastStatsTimeMills >= PUBLISH_STATS_INTERVAL_MILLS) {
+        lastStatsTimeMills = now;
+        int queueSize = NULL != packetPool ? packetPool->getRecordingVideoPacketQueueSize() : 0;
+        int queueDuration = NULL != packetPool ? packetPool->getRecordingVideoPacketQueueDurationMills() : 0;
+        printf("RecordingPublisher video time %.2lf audio time %.2lf, video queue %d packets %d ms\n",
+               getVideoStreamTimeInSecs(), getAudioStreamTimeInSecs(), queueSize, queueDuration);
+        LiveIOWriterStats stats;
+        if (getIOWriterStats(&stats)) {
+            printf("RecordingPublisher send rate %d kbps, queued %d bytes, stall %lld times %lld ms (max %d ms), reconnect %d times\n",
+                   stats.sendRateKbps, stats.queuedBytes, (long long)stats.stallCount,
+                   (long long)stats.totalStallMills, stats.maxStallMills, reconnectCount);
+        }
+    }
+    if (NULL != bitrateController && now - lastBitrateUpdateTimeMills >= ABR_UPDATE_INTERVAL_MILLS) {
+        lastBitrateUpdateTimeMills = now;
+        LiveIOWriterStats ioStats;
+        LiveDiscardStats discardStats;
+        if (getIOWriterStats(&ioStats) && NULL != packetPool) {
+            packetPool->getDiscardStats(&discardStats);
+            LiveBitrateSample sample;
+            sample.timeMills = now;
+            sample.sendRateKbps = ioStats.sendRateKbps;
+            sample.ioQueuedBytes = ioStats.queuedBytes;
+            sample.videoQueueDurationMills = packetPool->getRecordingVideoPacketQueueDurationMills();
+            sample.videoDroppedMills = discardStats.videoDroppedMills;
+            bitrateController->update(&sample);
+        }
+    }
+    // 队列一直取不到数据时 I/O 的超时回调不会被触发，在这里检测断流
+    if (isConnected && !isInterrupted() && now - sendLatestFrameTimemills > publishTimeout) {
+        printf("RecordingPublisher no packet sent in %lld ms\n", (long long)(now - sendLatestFrameTimemills));
+        if (NULL != onPublishTimeoutCallback) {
+            onPublishTimeoutCallback(timeoutContext);
+        }
+        return -1;
+    }
+    return 0;
+}
+
+bool RecordingPublisher::getIOWriterStats(LiveIOWriterStats *stats) {
+    if (NULL == ioWriter) {
+        return false;
+    }
+    ioWriter->getStats(stats);
+    return true;
+}
+
 int RecordingPublisher::stop() {
     printf("enter RecordingPublisher::stop...\n");
     int ret = 0;
-    if (isConnected && isWriteHeaderSuccess) {
-        printf("leave RecordingPublisher::stop() if (isConnected && isWriteHeaderSuccess)\n");
+    releaseBatches();
+    closeOutput(true);
+    printf("leave RecordingPublisher::stop...\n");
+    return ret;
+}
+
+void RecordingPublisher::closeOutput(bool writeTrailer) {
+    if (writeTrailer && isConnected && isWriteHeaderSuccess) {
+        printf("RecordingPublisher::closeOutput write trailer\n");
         av_write_trailer(oc);
         oc->duration = duration * AV_TIME_BASE; // 设置视频长度
     }
+    isWriteHeaderSuccess = false;
     if (video_st) {
         close_video(oc, video_st);
         video_st = NULL;
@@ -148,17 +493,39 @@ int RecordingPublisher::stop() {
         close_audio(oc, audio_st);
         audio_st = NULL;
     }
-    if (isConnected) {
-        if (!(fmt->flags & AVFMT_NOFILE)) {
-            avio_close(oc->pb);
+    if (NULL != ioWriter) {
+        avio_flush(oc->pb);
+        // 被打断或者要重连时网络写会立刻失败，不用再等
+        ioWriter->stop(!writeTrailer || isInterrupted() ? 0 : PUBLISH_DRAIN_TIMEOUT_MILLS);
+        oc->pb = NULL;
+        delete ioWriter;
+        ioWriter = NULL;
+    }
+    if (NULL != networkContext) {
+        if (NULL != oc && oc->pb == networkContext) {
+            oc->pb = NULL;
         }
-        isConnected = false;
+        avio_close(networkContext);
+        networkContext = NULL;
     }
+    isConnected = false;
     if (oc) {
         avformat_free_context(oc);
         oc = NULL;
     }
-    printf("leave RecordingPublisher::stop...\n");
+}
+
+enum AVCodecID RecordingPublisher::getVideoCodecId() {
+    return AV_CODEC_ID_H264;
+}
+
+int RecordingPublisher::write_header(AVFormatContext *oc, AVStream *st) {
+    int ret = avformat_write_header(oc, NULL);
+    if (ret < 0) {
+        printf("Error occurred when opening output file: %s\n", av_err2str(ret));
+    } else {
+        isWriteHeaderSuccess = true;
+    }
     return ret;
 }
 
@@ -178,9 +545,10 @@ int RecordingPublisher::buildAudioStream(char *audioCodecName) {
 int RecordingPublisher::buildVideoStream() {
     int ret = 1;
     AVCodec *video_codec = NULL;
-    fmt->video_codec = AV_CODEC_ID_H264;
-    if (fmt->video_codec != AV_CODEC_ID_NONE) {
-        video_st = add_stream(oc, &video_codec, fmt->video_codec, NULL);
+    // 不去改 fmt->video_codec，封装格式是全局共享的，多路会话可能用不同的编码
+    enum AVCodecID videoCodecId = getVideoCodecId();
+    if (videoCodecId != AV_CODEC_ID_NONE) {
+        video_st = add_stream(oc, &video_codec, videoCodecId, NULL);
     }
     if (video_st && video_codec) {
         if ((ret = open_video(oc, video_codec, video_st)) < 0) {
@@ -201,9 +569,13 @@ AVStream* RecordingPublisher::add_stream(AVFormatContext *oc, AVCodec **codec, e
     }
     if (!(*codec)) {
         printf("Could not find encoder for '%s'\n", avcodec_get_name(codecId));
-        return NULL;
+        // 视频是外部编码好的，封装不需要编码器
+        if (AV_CODEC_ID_NONE == codecId || AVMEDIA_TYPE_VIDEO != avcodec_get_type(codecId)) {
+            return NULL;
+        }
+    } else {
+        printf("\n find encoder name is '%s'\n", (*codec)->name);
     }
-    printf("\n find encoder name is '%s'\n", (*codec)->name);
     
     st = avformat_new_stream(oc, *codec);
     if (!st) {
@@ -213,7 +585,7 @@ AVStream* RecordingPublisher::add_stream(AVFormatContext *oc, AVCodec **codec, e
     st->id = oc->nb_streams - 1;
     c = st->codec;
     
-    switch ((*codec)->type) {
+    switch (NULL != *codec ? (*codec)->type : avcodec_get_type(codecId)) {
         case AVMEDIA_TYPE_AUDIO:
             printf("audioBitRate is %d audioChannels is %d audioSampleRate is %d\n", audioBitRate,
                  audioChannels, audioSampleRate);
@@ -226,7 +598,8 @@ AVStream* RecordingPublisher::add_stream(AVFormatContext *oc, AVCodec **codec, e
             c->flags |= CODEC_FLAG_GLOBAL_HEADER;
             break;
         case AVMEDIA_TYPE_VIDEO:
-            c->codec_id = AV_CODEC_ID_H264;
+            c->codec_type = AVMEDIA_TYPE_VIDEO;
+            c->codec_id = codecId;
             c->bit_rate = videoBitRate;
             c->width = videoWidth;
             c->height = videoHeight;
@@ -246,10 +619,12 @@ AVStream* RecordingPublisher::add_stream(AVFormatContext *oc, AVCodec **codec, e
             c->qmin = 10;
             c->qmax = 30;
             c->pix_fmt = COLOR_FORMAT;
-            // 新增语句，设置为编码延迟
-            av_opt_set(c->priv_data, "preset", "ultrafast", 0);
-            // 实时编码关键看这句，上面那条无所谓
-            av_opt_set(c->priv_data, "tune", "zerolatency", 0);
+            if (NULL != c->priv_data) {
+                // 新增语句，设置为编码延迟
+                av_opt_set(c->priv_data, "preset", "ultrafast", 0);
+                // 实时编码关键看这句，上面那条无所谓
+                av_opt_set(c->priv_data, "tune", "zerolatency", 0);
+            }
             
             printf("sample_aspect_ratio = %d   %d", c->sample_aspect_ratio.den, c->sample_aspect_ratio.num);
             
@@ -310,7 +685,6 @@ int RecordingPublisher::open_audio(AVFormatContext *oc, AVCodec *codec, AVStream
     dsi[0] = (object_type << 3) | (get_sr_index(c->sample_rate) >> 1);
     dsi[1] = ((get_sr_index(c->sample_rate) & 1) << 7) | (c->channels << 3);
     memcpy(c->extradata, dsi, 2); // FFmpeg 设置 extradata 的目的是为解码器提供原始数据，从而初始化解码器，类似于编码 AAC 前面加上 ADTS 的头，ADTS 头部信息可以提取编码器的 Profile、采样率以及声道数的信息
-    bsfc = av_bitstream_filter_init("aac_adtstoasc"); // This filter creates an MPEG-4 AudioSpecificConfig from an MPEG-2/4 ADTS header and removes the ADTS header.
     return 1;
 }
 
@@ -318,36 +692,110 @@ double RecordingPublisher::getAudioStreamTimeInSecs() {
     return lastAudioPacketPresentationTimeMills / 1000.0f;
 }
 
-int RecordingPublisher::write_audio_frame(AVFormatContext *oc, AVStream *st) {
+/* 同步字 0xFFF 开头并且 frame_length 正好是整个包的长度才认为带 ADTS 头 */
+static bool isADTSFrame(const uint8_t *data, int size) {
+    if (NULL == data || size <= AAC_ADTS_HEADER_SIZE) {
+        return false;
+    }
+    if (data[0] != 0xFF || (data[1] & 0xF0) != 0xF0) {
+        return false;
+    }
+    int frameLength = ((data[3] & 0x03) << 11) | (data[4] << 3) | (data[5] >> 5);
+    return frameLength == size;
+}
+
+static void releaseAudioPacketData(void *opaque, uint8_t *data) {
+    LiveBufferPool *bufferPool = (LiveBufferPool *)opaque;
+    if (NULL != bufferPool) {
+        bufferPool->recycle(data);
+    } else {
+        delete[] data;
+    }
+}
+
+int RecordingPublisher::write_audio_frame(AVFormatContext *oc, AVStream *st, LiveAudioPacket *audioPacket) {
     int ret = AUDIO_QUEUE_ABORT_ERR_CODE;
-    LiveAudioPacket *audioPacket = NULL;
-    if ((ret = fillAACPacketCallback(&audioPacket, fillAACPacketContext)) > 0) {
+    if (NULL != audioPacket) {
         AVPacket pkt = {0};
         av_init_packet(&pkt);
         lastAudioPacketPresentationTimeMills = audioPacket->position;
-        pkt.data = audioPacket->data;
-        pkt.size = audioPacket->size;
-        pkt.dts = pkt.pts = lastAudioPacketPresentationTimeMills / 1000.0f / av_q2d(st->time_base);
-        pkt.duration = 1024;
+        if (audioPacket->sampleRate > 0) {
+            // 采样数直接换算到流的时间基，每个包单独取整，误差不会累积
+            AVRational sampleTimeBase = {1, audioPacket->sampleRate};
+            pkt.dts = pkt.pts = av_rescale_q(audioPacket->pts, sampleTimeBase, st->time_base);
+            pkt.duration = (int)av_rescale_q(audioPacket->duration, sampleTimeBase, st->time_base);
+        } else {
+            // 没有采样时间戳的包只能按毫秒换算
+            AVRational millsTimeBase = {1, 1000};
+            pkt.dts = pkt.pts = av_rescale_q((int64_t)lastAudioPacketPresentationTimeMills, millsTimeBase, st->time_base);
+            pkt.duration = 1024;
+        }
         pkt.stream_index = st->index;
-        AVPacket newPacket;
-        av_init_packet(&newPacket);
-        ret = av_bitstream_filter_filter(bsfc, st->codec, NULL, &newPacket.data, &newPacket.size, pkt.data, pkt.size, pkt.flags & AV_PKT_FLAG_KEY);
-        if (ret >= 0) {
-            newPacket.pts = pkt.pts;
-            newPacket.dts = pkt.dts;
-            newPacket.duration = pkt.duration;
-            newPacket.stream_index = pkt.stream_index;
-//            printf("write_audio_frame %d\n", newPacket.size);
-            ret = this->interleavedWriteFrame(oc, &newPacket);
-            if (ret != 0) {
-                printf("Error while writing audio frame: %s\n", av_err2str(ret));
+        uint8_t *filteredData = NULL;
+        if (isADTSFrame(audioPacket->data, audioPacket->size)) {
+            // 带 ADTS 头的输入才走 aac_adtstoasc 去掉头，过滤器第一次用到时才创建
+#ifdef LIVE_FFMPEG_HAS_BSF
+            if (NULL == bsfc && (ret = openADTSFilter(st)) < 0) {
+                delete audioPacket;
+                return ret;
+            }
+            // 输入包引用池里的 buffer，后面已经补好了 0，过滤器只是跳过 ADTS 头，不会再复制数据
+            AVPacket inPkt = pkt;
+            inPkt.data = audioPacket->data;
+            inPkt.size = audioPacket->size;
+            inPkt.buf = av_buffer_create(audioPacket->data, audioPacket->size + AUDIO_PACKET_PADDING_SIZE, releaseAudioPacketData, audioPacket->bufferPool, 0);
+            if (NULL != inPkt.buf) {
+                audioPacket->data = NULL;
             }
+            ret = av_bsf_send_packet(bsfc, &inPkt);
+            if (ret >= 0) {
+                ret = av_bsf_receive_packet(bsfc, &pkt);
+            }
+            av_packet_unref(&inPkt);
+            if (AVERROR(EAGAIN) == ret) {
+                // 过滤器还没有输出，这个包不用写
+                delete audioPacket;
+                return 0;
+            }
+            if (ret < 0) {
+                printf("Error aac_adtstoasc filter: %s\n", av_err2str(ret));
+                delete audioPacket;
+                return ret;
+            }
+            pkt.stream_index = st->index;
+#else
+            if (NULL == bsfc) {
+                bsfc = av_bitstream_filter_init("aac_adtstoasc");
+            }
+            ret = av_bitstream_filter_filter(bsfc, st->codec, NULL, &pkt.data, &pkt.size, audioPacket->data, audioPacket->size, 0);
+            if (ret < 0) {
+                printf("Error av_bitstream_filter_filter: %s\n", av_err2str(ret));
+                delete audioPacket;
+                return ret;
+            }
+            if (ret > 0) {
+                filteredData = pkt.data; // 过滤器新分配了输出，写完自己释放
+            }
+#endif
         } else {
-            printf("Error av_bitstream_filter_filter: %s\n", av_err2str(ret));
+            // 编码器用 CODEC_FLAG_GLOBAL_HEADER 打开，出来的是裸 AAC 帧，AudioSpecificConfig 在 open_audio 里已经填好，直接交给封装器
+            // 数据的所有权交给 AVPacket，av_interleaved_write_frame 不用再复制一份
+            pkt.data = audioPacket->data;
+            pkt.size = audioPacket->size;
+            pkt.buf = av_buffer_create(audioPacket->data, audioPacket->size + AUDIO_PACKET_PADDING_SIZE, releaseAudioPacketData, audioPacket->bufferPool, 0);
+            if (NULL != pkt.buf) {
+                audioPacket->data = NULL;
+            }
+        }
+//        printf("write_audio_frame %d\n", pkt.size);
+        ret = this->interleavedWriteFrame(oc, &pkt);
+        if (ret != 0) {
+            printf("Error while writing audio frame: %s\n", av_err2str(ret));
         }
-        av_free_packet(&newPacket);
         av_free_packet(&pkt);
+        if (NULL != filteredData) {
+            av_free(filteredData);
+        }
         delete audioPacket;
     } else {
         ret = AUDIO_QUEUE_ABORT_ERR_CODE;
@@ -356,8 +804,8 @@ int RecordingPublisher::write_audio_frame(AVFormatContext *oc, AVStream *st) {
 }
 
 int RecordingPublisher::interleavedWriteFrame(AVFormatContext *s, AVPacket *pkt) {
-    if (startSendTime == 0) {
-        startSendTime = platform_4_live::getCurrentTimeMills();
+    if (startSendTime < 0) {
+        startSendTime = platform_4_live::getMonotonicTimeMills();
     }
     int ret = av_interleaved_write_frame(s, pkt);
     return ret;
@@ -374,6 +822,36 @@ void RecordingPublisher::close_audio(AVFormatContext *oc, AVStream *st) {
         avcodec_close(st->codec);
     }
     if (NULL != bsfc) {
+#ifdef LIVE_FFMPEG_HAS_BSF
+        av_bsf_free(&bsfc);
+#else
         av_bitstream_filter_close(bsfc);
+        bsfc = NULL;
+#endif
+    }
+}
+
+#ifdef LIVE_FFMPEG_HAS_BSF
+int RecordingPublisher::openADTSFilter(AVStream *st) {
+    const AVBitStreamFilter *filter = av_bsf_get_by_name("aac_adtstoasc");
+    if (NULL == filter) {
+        printf("Could not find aac_adtstoasc filter\n");
+        return AVERROR_BSF_NOT_FOUND;
     }
+    int ret = av_bsf_alloc(filter, &bsfc);
+    if (ret < 0) {
+        return ret;
+    }
+    // 过滤器按音频流的参数初始化，时间戳原样透传
+    ret = avcodec_parameters_from_context(bsfc->par_in, st->codec);
+    if (ret >= 0) {
+        bsfc->time_base_in = st->time_base;
+        ret = av_bsf_init(bsfc);
+    }
+    if (ret < 0) {
+        printf("Could not init aac_adtstoasc filter: %s\n", av_err2str(ret));
+        av_bsf_free(&bsfc);
+    }
+    return ret;
 }
+#endif
@@ -14,6 +14,9 @@
 #include "live_video_packet_queue.h"
 #include "live_audio_packet_queue.h"
 #include "live_packet_pool.h"
+#include "live_packet_notifier.h"
+#include "live_io_writer.h"
+#include "live_bitrate_controller.h"
 
 #define COLOR_FORMAT            AV_PIX_FMT_BGRA
 #ifndef PUBLISH_DATA_TIME_OUT
@@ -23,6 +26,27 @@
 #define AUDIO_QUEUE_ABORT_ERR_CODE               -100200
 #define VIDEO_QUEUE_ABORT_ERR_CODE               -100201
 
+// 发送线程一次从队列里取出的最大包数，以及队列为空时一次最多等待的时间
+#define PUBLISH_PACKET_BATCH_SIZE                32
+#define PUBLISH_PACKET_BATCH_MAX_WAIT_MILLS      100
+#define PUBLISH_STATS_INTERVAL_MILLS             5000
+#define PUBLISH_DRAIN_TIMEOUT_MILLS              1000
+// 一路流暂时没有包时，另一路最多领先它这么多毫秒写出；一路流这么久没从队列里取到过包就认为断了，另一路不再等它
+#define PUBLISH_INTERLEAVE_WINDOW_MILLS          200
+#define PUBLISH_STREAM_SILENT_MILLS              500
+
+#define PUBLISH_STREAM_NONE                      0
+#define PUBLISH_STREAM_AUDIO                     1
+#define PUBLISH_STREAM_VIDEO                     2
+
+// 写出失败后原地重连：退避时间从 INITIAL 开始翻倍到 MAX，总共最多重试 MAX_DURATION，每次连接最多等 ATTEMPT_TIMEOUT
+#define PUBLISH_RECONNECT_INITIAL_BACKOFF_MILLS  200
+#define PUBLISH_RECONNECT_MAX_BACKOFF_MILLS      3200
+#define PUBLISH_RECONNECT_MAX_DURATION_MILLS     30000
+#define PUBLISH_RECONNECT_ATTEMPT_TIMEOUT_MILLS  5000
+
+#define AAC_ADTS_HEADER_SIZE                     7
+
 #ifndef PUBLISH_INVALID_FLAG
 #define PUBLISH_INVALID_FLAG -1
 #endif
@@ -36,42 +60,75 @@ public:
     
     int detectTimeout();
     
-    virtual int init(char *videoOutputURI,
+    virtual int init(LivePacketPool *packetPool,
+                     char *videoOutputURI,
                      int videoWidth, int videoHeight, int videoFrameRate, int videoBitRate,
                      int audioSampleRate, int audioChannels, int audioBitRate, char *audioCodecName);
     
-    virtual void registerFillAACPacketCallback(int (*fill_aac_packet)(LiveAudioPacket **, void *context), void *context);
-    virtual void registerFillVideoPacketCallback(int (*fill_packet_frame)(LiveVideoPacket **, void *context), void *context);
+    virtual void registerFillAACPacketCallback(int (*fill_aac_packet)(LiveAudioPacket **, int maxCount, int maxWaitMills, void *context), void *context);
+    virtual void registerFillVideoPacketCallback(int (*fill_packet_frame)(LiveVideoPacket **, int maxCount, int maxWaitMills, void *context), void *context);
     virtual void registerPublishTimeoutCallback(int (*on_publish_timeout_callback)(void *context), void *context);
+    /* 由这一路输出的拥塞情况驱动码率调整，不接管 controller */
+    void setBitrateController(LiveBitrateController *controller);
+    /* 音视频两个队列共用的到达通知，设置之后 encode 同时等两路数据，不接管 notifier */
+    void setPacketNotifier(LivePacketNotifier *notifier);
     
     int encode();
+    /* 发送线程每轮 encode 之后调用，在等数据超时的间隙里做断流检测和统计，返回 < 0 表示需要停止 */
+    int heartbeat();
+    /* 网络发送线程的统计：实际上行速率、发送队列积压、写阻塞时间 */
+    bool getIOWriterStats(LiveIOWriterStats *stats);
     
     virtual int stop();
     
-    void interruptPublisherPipe() {
-        this->publishTimeout = PUBLISH_INVALID_FLAG;
-    }
+    /* 打断正在进行的网络 I/O 和重连等待 */
+    void interruptPublisherPipe();
     
     inline bool isInterrupted() {
         return this->publishTimeout == PUBLISH_INVALID_FLAG;
     }
 
-    typedef int (*fill_aac_packet_callback)(LiveAudioPacket **, void *context);
-    typedef int (*fill_h264_packet_callback)(LiveVideoPacket **, void *context);
+    /* 一次取出最多 maxCount 个包，return < 0 if aborted, 0 if timeout and > 0 the packet count. */
+    typedef int (*fill_aac_packet_callback)(LiveAudioPacket **, int maxCount, int maxWaitMills, void *context);
+    typedef int (*fill_h264_packet_callback)(LiveVideoPacket **, int maxCount, int maxWaitMills, void *context);
     typedef int (*on_publish_timeout_callback)(void *context);
     
 protected:
     virtual AVStream* add_stream(AVFormatContext *oc, AVCodec **codec, enum AVCodecID codecId, char *codecName);
     virtual int open_video(AVFormatContext *oc, AVCodec *codec, AVStream *st);
     int open_audio(AVFormatContext *oc, AVCodec *codec, AVStream *st);
-    virtual int write_video_frame(AVFormatContext *oc, AVStream *st) = 0;
-    virtual int write_audio_frame(AVFormatContext *oc, AVStream *st);
+    /* 写出一个包并释放它 */
+    virtual int write_video_frame(AVFormatContext *oc, AVStream *st, LiveVideoPacket *h264Packet) = 0;
+    virtual int write_audio_frame(AVFormatContext *oc, AVStream *st, LiveAudioPacket *audioPacket);
     virtual void close_video(AVFormatContext *oc, AVStream *st);
     void close_audio(AVFormatContext *oc, AVStream *st);
     virtual double getVideoStreamTimeInSecs() = 0;
     double getAudioStreamTimeInSecs();
+    /* 视频流的编码格式，视频是外部编码好的，只用来建流和检查封装格式是否支持 */
+    virtual enum AVCodecID getVideoCodecId();
+    /* 写出视频流的头，子类在这里用缓存的 SPS/PPS 填好 extradata */
+    virtual int write_header(AVFormatContext *oc, AVStream *st);
     int buildVideoStream();
     int buildAudioStream(char *audioCodecName);
+    /* 建立封装上下文和音视频流，打开网络连接 */
+    int openOutput();
+    /* 关闭网络连接并释放封装上下文，队列和已经取出的包都保留 */
+    void closeOutput(bool writeTrailer);
+    /* 写出失败后原地重连，成功后补写头，从下一个 IDR 继续发送 */
+    int reconnect();
+    bool isNetworkOutput();
+    /* 批取空之后再去队列里取，最多等 maxWaitMills */
+    int fillAudioBatch(int maxWaitMills);
+    int fillVideoBatch(int maxWaitMills);
+    /* 不等待地补上取空的批，队列 abort 时返回 < 0 */
+    int refillBatches();
+    /* 按两路队头的时间戳和交错窗口选出下一个要写的流，都不能写时 maxWaitMills 给出最多等多久再选一次 */
+    int chooseNextStream(int *maxWaitMills);
+    /* 等任意一路来数据，超时返回 ETIMEDOUT */
+    int waitForPackets(int64_t sequence, int64_t deadlineMills);
+    /* 从视频批里取出下一个包，同时把它从包池的队列预算里去掉 */
+    LiveVideoPacket *takeVideoPacket();
+    void releaseBatches();
     
 protected:
     // sps and pps data
@@ -79,15 +136,26 @@ protected:
     int headerSize;
     int publishTimeout;
     
-    int startSendTime = 0;
+    LivePacketPool *packetPool; // 所属会话的包池，用来打印队列状态、采样码率调节的队列时长和归还批次里的包
+    char *videoOutputURI;
+    char *audioCodecName;
+    
+    int64_t startSendTime = -1;
     
     int interleavedWriteFrame(AVFormatContext *s, AVPacket *pkt);
 
     AVOutputFormat *fmt;
     AVFormatContext *oc;
+    AVIOContext *networkContext; // avio_open2 打开的输出，网络输出只在 ioWriter 的线程里写，本地文件直接给 muxer 用
+    LiveIOWriter *ioWriter;
     AVStream *video_st;
     AVStream *audio_st;
-    AVBitStreamFilterContext *bsfc;
+#ifdef LIVE_FFMPEG_HAS_BSF
+    AVBSFContext *bsfc; // 只有输入带 ADTS 头时才创建
+    int openADTSFilter(AVStream *st);
+#else
+    AVBitStreamFilterContext *bsfc; // 只有输入带 ADTS 头时才创建
+#endif
     double duration;
     
     double lastAudioPacketPresentationTimeMills;
@@ -100,16 +168,38 @@ protected:
     int audioChannels;
     int audioBitRate;
     
+    // 从队列里批量取出、还没写出的包
+    LiveAudioPacket *audioBatch[PUBLISH_PACKET_BATCH_SIZE];
+    int audioBatchCount;
+    int audioBatchIndex;
+    LiveVideoPacket *videoBatch[PUBLISH_PACKET_BATCH_SIZE];
+    int videoBatchCount;
+    int videoBatchIndex;
+    
     fill_aac_packet_callback fillAACPacketCallback;
     void *fillAACPacketContext;
     fill_h264_packet_callback fillH264PacketCallback;
     void *fillH264PacketContext;
+    LivePacketNotifier *packetNotifier;
+    int64_t lastAudioArrivalMills; // 最后一次从队列里取到包的时间，用来判断一路流是不是断了
+    int64_t lastVideoArrivalMills;
     on_publish_timeout_callback onPublishTimeoutCallback;
     void *timeoutContext;
+    LiveBitrateController *bitrateController;
     
-    long sendLatestFrameTimemills; // 为了纪录发出的最后一帧的发送时间, 以便于判断超时
+    int64_t sendLatestFrameTimemills; // 为了纪录发出的最后一帧的发送时间, 以便于判断超时
+    int64_t lastStatsTimeMills;
+    int64_t lastBitrateUpdateTimeMills;
     bool isConnected;
     bool isWriteHeaderSuccess;
+    
+    bool isReconnecting;
+    bool isWaitingForKeyFrame; // 重连之后丢掉视频直到下一个 IDR
+    double resumeTimeMills; // 重连之后第一个 IDR 的时间，早于它的音频直接丢掉
+    int reconnectCount;
+    int64_t reconnectSkippedVideoFrames;
+    pthread_mutex_t reconnectLock;
+    pthread_cond_t reconnectCondition;
 };
 
 #endif /* recording_publisher_h */
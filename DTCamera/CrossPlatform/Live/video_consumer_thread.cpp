@@ -10,18 +10,21 @@
 
 VideoConsumerThread::VideoConsumerThread() {
     isStopping = false;
+    packetPool = NULL;
+    aacPacketPool = NULL;
     videoPublisher = NULL;
+    packetNotifier = new LivePacketNotifier();
+    videoCodec = LIVE_VIDEO_CODEC_H264;
     isConnecting = false;
     
     pthread_mutex_init(&connectingLock, NULL);
     pthread_cond_init(&interruptCondition, NULL);
-    pthread_mutex_init(&interruptLock, NULL);
 }
 
 VideoConsumerThread::~VideoConsumerThread() {
+    delete packetNotifier;
     pthread_mutex_destroy(&connectingLock);
     pthread_cond_destroy(&interruptCondition);
-    pthread_mutex_destroy(&interruptLock);
 }
 
 void VideoConsumerThread::registerPublishTimeoutCallback(int (*on_publish_timeout_callback)(void *context), void *context) {
@@ -30,70 +33,86 @@ void VideoConsumerThread::registerPublishTimeoutCallback(int (*on_publish_timeou
     }
 }
 
-static int fill_aac_packet_callback(LiveAudioPacket **packet, void *context) {
+void VideoConsumerThread::setBitrateController(LiveBitrateController *controller) {
+    if (NULL != videoPublisher) {
+        videoPublisher->setBitrateController(controller);
+    }
+}
+
+void VideoConsumerThread::setVideoCodec(int videoCodec) {
+    this->videoCodec = videoCodec;
+}
+
+static int fill_aac_packet_callback(LiveAudioPacket **packets, int maxCount, int maxWaitMills, void *context) {
     VideoConsumerThread *consumer = (VideoConsumerThread *)context;
-    return consumer->getAudioPacket(packet);
+    return consumer->getAudioPackets(packets, maxCount, maxWaitMills);
 }
 
-int VideoConsumerThread::getAudioPacket(LiveAudioPacket **audioPacket) {
-    if (aacPacketPool->getAudioPacket(audioPacket, true) < 0) {
-        printf("aacPacketPool->getAudioPacket return negetive value...\n");
+int VideoConsumerThread::getAudioPackets(LiveAudioPacket **audioPackets, int maxCount, int maxWaitMills) {
+    int ret = aacPacketPool->getAudioPackets(audioPackets, maxCount, maxWaitMills);
+    if (ret < 0) {
+        printf("aacPacketPool->getAudioPackets return negetive value...\n");
         return -1;
     }
-    return 1;
+    return ret;
 }
 
-static int fill_h264_packet_callback(LiveVideoPacket **packet, void *context) {
+static int fill_h264_packet_callback(LiveVideoPacket **packets, int maxCount, int maxWaitMills, void *context) {
     VideoConsumerThread *consumer = (VideoConsumerThread *)context;
-    return consumer->getH264Packet(packet);
+    return consumer->getH264Packets(packets, maxCount, maxWaitMills);
 }
 
-int VideoConsumerThread::getH264Packet(LiveVideoPacket **packet) {
-    if (packetPool->getRecordingVideoPacket(packet, true) < 0) {
-        printf("packetPool->getRecordingVideoPacket return negetive value...\n");
+int VideoConsumerThread::getH264Packets(LiveVideoPacket **packets, int maxCount, int maxWaitMills) {
+    int ret = packetPool->getRecordingVideoPackets(packets, maxCount, maxWaitMills);
+    if (ret < 0) {
+        printf("packetPool->getRecordingVideoPackets return negetive value...\n");
         return -1;
     }
-    return 1;
+    return ret;
 }
 
 void VideoConsumerThread::init() {
-    isStopping = false;
-    packetPool = LivePacketPool::GetInstance();
-    aacPacketPool = LiveAudioPacketPool::GetInstance();
     videoPublisher = NULL;
 }
 
-int VideoConsumerThread::init(char *videoOutputURI, int videoWidth, int videoHeight, int videoFrameRate, int videoBitRate, int audioSampleRate, int audioChannels, int audioBitRate, char *audioCodecName) {
+int VideoConsumerThread::init(LivePacketPool *packetPool, LiveAudioPacketPool *aacPacketPool, char *videoOutputURI, int videoWidth, int videoHeight, int videoFrameRate, int videoBitRate, int audioSampleRate, int audioChannels, int audioBitRate, char *audioCodecName) {
     init();
-    if (NULL == videoPublisher) {
-        pthread_mutex_lock(&connectingLock);
-        this->isConnecting = true;
+    buildPublisherInstance();
+    // 队列和 isConnecting 在同一把锁里设置，stop 要么看到还没 init，要么能打断这次连接
+    pthread_mutex_lock(&connectingLock);
+    if (isStopping) {
         pthread_mutex_unlock(&connectingLock);
-        buildPublisherInstance();
-        int ret = videoPublisher->init(videoOutputURI, videoWidth, videoHeight, videoFrameRate, videoBitRate, audioSampleRate, audioChannels, audioBitRate, audioCodecName);
-        pthread_mutex_lock(&connectingLock);
+        printf("Client Cancel before connect ...\n");
+        delete videoPublisher;
+        videoPublisher = NULL;
+        return CLIENT_CANCEL_CONNECT_ERR_CODE;
+    }
+    this->packetPool = packetPool;
+    this->aacPacketPool = aacPacketPool;
+    this->isConnecting = true;
+    pthread_mutex_unlock(&connectingLock);
+    int ret = videoPublisher->init(packetPool, videoOutputURI, videoWidth, videoHeight, videoFrameRate, videoBitRate, audioSampleRate, audioChannels, audioBitRate, audioCodecName);
+    printf("videoPublisher->init return code %d...\n", ret);
+    pthread_mutex_lock(&connectingLock);
+    if (ret >= 0 && !videoPublisher->isInterrupted() && !isStopping) {
+        videoPublisher->registerFillAACPacketCallback(fill_aac_packet_callback, this);
+        videoPublisher->registerFillVideoPacketCallback(fill_h264_packet_callback, this);
+        packetPool->setRecordingVideoPacketNotifier(packetNotifier);
+        aacPacketPool->setAudioPacketNotifier(packetNotifier);
+        videoPublisher->setPacketNotifier(packetNotifier);
         this->isConnecting = false;
         pthread_mutex_unlock(&connectingLock);
-        printf("videoPublisher->init return code %d...\n", ret);
-        if (ret < 0 || videoPublisher->isInterrupted()) {
-            printf("videoPublisher->init failed...\n");
-            pthread_mutex_lock(&interruptLock);
-            
-            this->releasePublisher();
-            
-            pthread_cond_signal(&interruptCondition);
-            pthread_mutex_unlock(&interruptLock);
-            return ret;
-        }
-        if (!isStopping) {
-            videoPublisher->registerFillAACPacketCallback(fill_aac_packet_callback, this);
-            videoPublisher->registerFillVideoPacketCallback(fill_h264_packet_callback, this);
-        } else {
-            printf("Client Cancel ...\n");
-            return CLIENT_CANCEL_CONNECT_ERR_CODE;
-        }
+        return 0;
     }
-    return 0;
+    pthread_mutex_unlock(&connectingLock);
+    printf("videoPublisher->init failed...\n");
+    this->releasePublisher();
+    // 发布者释放完才清掉 isConnecting，等在 stop 里的线程返回后不会再有人碰队列
+    pthread_mutex_lock(&connectingLock);
+    this->isConnecting = false;
+    pthread_cond_broadcast(&interruptCondition);
+    pthread_mutex_unlock(&connectingLock);
+    return ret < 0 ? ret : CLIENT_CANCEL_CONNECT_ERR_CODE;
 }
 
 void VideoConsumerThread::releasePublisher() {
@@ -105,22 +124,31 @@ void VideoConsumerThread::releasePublisher() {
 }
 
 void VideoConsumerThread::buildPublisherInstance() {
-    videoPublisher = new RecordingH264Publisher();
+    if (LIVE_VIDEO_CODEC_HEVC == videoCodec) {
+        videoPublisher = new RecordingHEVCPublisher();
+    } else {
+        videoPublisher = new RecordingH264Publisher();
+    }
 }
 
 void VideoConsumerThread::stop() {
     printf("enter VideoConsumerThread::stop...\n");
     pthread_mutex_lock(&connectingLock);
+    isStopping = true;
+    if (NULL == packetPool) {
+        // 还没有 init，之后的 init 看到 isStopping 直接返回，不会再去连接
+        pthread_mutex_unlock(&connectingLock);
+        printf("VideoConsumerThread::stop before init return...\n");
+        return;
+    }
     if (isConnecting) {
         printf("before interruptPublisherPipe()\n");
         videoPublisher->interruptPublisherPipe();
         printf("after interruptPublisherPipe()\n");
+        while (isConnecting) {
+            pthread_cond_wait(&interruptCondition, &connectingLock);
+        }
         pthread_mutex_unlock(&connectingLock);
-        
-        pthread_mutex_lock(&interruptLock);
-        pthread_cond_wait(&interruptCondition, &interruptLock);
-        pthread_mutex_unlock(&interruptLock);
-        
         printf("VideoConsumerThread::stop isConnecting return...\n");
         return;
     }
@@ -128,10 +156,9 @@ void VideoConsumerThread::stop() {
     
     int ret = -1;
     
-    isStopping = true;
     packetPool->abortRecordingVideoPacketQueue();
     aacPacketPool->abortAudioPacketQueue();
-    long startEndingThreadTimeMills = platform_4_live::getCurrentTimeMills();
+    int64_t startEndingThreadTimeMills = platform_4_live::getMonotonicTimeMills();
     printf("before wait publisher encoder ...\n");
     
     if (videoPublisher != NULL) {
@@ -140,7 +167,7 @@ void VideoConsumerThread::stop() {
     if ((ret = wait()) != 0) {
         printf("Couldn't cancel VideoConsumerThread: %d\n", ret);
     }
-    printf("after wait publisher encoder ... %d\n", (int)(platform_4_live::getCurrentTimeMills() - startEndingThreadTimeMills));
+    printf("after wait publisher encoder ... %d\n", (int)(platform_4_live::getMonotonicTimeMills() - startEndingThreadTimeMills));
 
     this->releasePublisher();
 
@@ -151,7 +178,11 @@ void VideoConsumerThread::stop() {
 
 void VideoConsumerThread::handleRun(void *ptr) {
     while (mRunning) {
+        // encode 等数据最多 PUBLISH_PACKET_BATCH_MAX_WAIT_MILLS，队列断流时也能回到这里做心跳
         int ret = videoPublisher->encode();
+        if (ret >= 0) {
+            ret = videoPublisher->heartbeat();
+        }
         if (ret < 0) {
             printf("videoPublisher->encode result is invalid, so we will stop encode...\n");
             break;
@@ -14,6 +14,7 @@
 #include "live_packet_pool.h"
 #include "live_audio_packet_pool.h"
 #include "recording_h264_publisher.h"
+#include "recording_hevc_publisher.h"
 
 #define CLIENT_CANCEL_CONNECT_ERR_CODE               -100199
 
@@ -21,25 +22,30 @@ class VideoConsumerThread: public LiveThread {
 public:
     VideoConsumerThread();
     virtual ~VideoConsumerThread();
-    int init(char *videoOutputURI,
+    int init(LivePacketPool *packetPool, LiveAudioPacketPool *aacPacketPool,
+             char *videoOutputURI,
              int videoWidth, int videoHeight, int videoFrameRate, int videoBitRate,
              int audioSampleRate, int audioChannels, int audioBitRate, char *audioCodecName);
     virtual void stop();
     
     void registerPublishTimeoutCallback(int (*on_publish_timeout_callback)(void *context), void *context);
+    void setBitrateController(LiveBitrateController *controller);
+    /* init 之前调用，决定建哪一种发布者，默认 LIVE_VIDEO_CODEC_H264 */
+    void setVideoCodec(int videoCodec);
     
-    int getH264Packet(LiveVideoPacket **packet);
-    int getAudioPacket(LiveAudioPacket **audioPacket);
+    int getH264Packets(LiveVideoPacket **packets, int maxCount, int maxWaitMills);
+    int getAudioPackets(LiveAudioPacket **audioPackets, int maxCount, int maxWaitMills);
     
 protected:
     LivePacketPool *packetPool;
     LiveAudioPacketPool *aacPacketPool;
     RecordingPublisher *videoPublisher;
+    LivePacketNotifier *packetNotifier; // 音视频两个队列共用，发送线程在上面同时等两路数据
+    int videoCodec;
     bool isStopping;
     bool isConnecting;
-    pthread_mutex_t connectingLock;
-    pthread_mutex_t interruptLock;
-    pthread_cond_t interruptCondition;
+    pthread_mutex_t connectingLock; // 保护 isStopping / isConnecting 和 init 里设置队列、注册回调的那两段
+    pthread_cond_t interruptCondition; // 和 connectingLock 一起用，被打断的连接释放完发布者后通知 stop
 
     virtual void init();
     virtual void buildPublisherInstance();
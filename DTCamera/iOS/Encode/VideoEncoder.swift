@@ -33,6 +33,8 @@ class VideoEncoder {
 
     private var isReady = false
     private var encodingTimeMills: Int64 = -1
+    private var targetFps: Int // 码率控制降帧率时小于 fps，多出来的帧直接丢掉
+    private var nextDueMills: Double = -1 // 降帧率时下一帧最早的编码时间，按目标帧率累加
     var isKeyframeFound = false
     
     private var session: VTCompressionSession!
@@ -43,6 +45,7 @@ class VideoEncoder {
         self.fps = fps
         self.maxBitRate = maxBitRate
         self.avgBitRate = avgBitRate
+        self.targetFps = fps
         
         encodeQueue.async { [weak self] in
             guard let self = self else { return }
@@ -81,6 +84,16 @@ class VideoEncoder {
         VTSessionSetProperty(session, key: kVTCompressionPropertyKey_AverageBitRate, value: avgBitRate as CFTypeRef) // 控制码率
     }
     
+    func adjust(bitRate: Int, fps: Int) {
+        encodeQueue.async { [weak self] in
+            guard let self = self, self.isReady else { return }
+            self.targetFps = min(fps, self.fps)
+            // 峰值码率跟着平均码率等比例缩放，保留初始化时两者之间的余量
+            let maxBitRate = Int(Int64(bitRate) * Int64(self.maxBitRate) / Int64(max(self.avgBitRate, 1)))
+            self.setMaxBitRate(maxBitRate, avgBitRate: bitRate, fps: self.targetFps)
+        }
+    }
+    
     func encode(pixelBuffer: CVPixelBuffer) {
         if continuousEncodeFailureTimes > continuousEncodeFailureTimesTreshold {
             delegate?.videoEncoderEncodedFailed(self)
@@ -94,9 +107,22 @@ class VideoEncoder {
                 self.encodingTimeMills = currentTimeMills
             }
             let encodingDuration = currentTimeMills - self.encodingTimeMills
+            if self.targetFps > 0 && self.targetFps < self.fps {
+                let frameInterval = 1000.0 / Double(self.targetFps)
+                let encodingTime = Double(encodingDuration)
+                // 采集时间有抖动，提前不到半个采集帧的也算到点
+                if self.nextDueMills >= 0 && encodingTime + 500.0 / Double(self.fps) < self.nextDueMills {
+                    return
+                }
+                // 从上一个到点时间累加，不从这一帧的实际时间重新算，输出帧率才等于目标帧率；卡顿之后不补帧
+                let baseMills = self.nextDueMills < 0 ? encodingTime : max(self.nextDueMills, encodingTime - frameInterval)
+                self.nextDueMills = baseMills + frameInterval
+            } else {
+                self.nextDueMills = -1
+            }
             
             let pts = CMTimeMake(value: encodingDuration, timescale: 1000) // 当前编码视频帧的时间戳，单位为毫秒
-            let duration = CMTimeMake(value: 1, timescale: Int32(self.fps)) // 当前编码视频帧的时长
+            let duration = CMTimeMake(value: 1, timescale: Int32(self.targetFps)) // 当前编码视频帧的时长
             
             let statusCode = VTCompressionSessionEncodeFrame(self.session,
                                                              imageBuffer: pixelBuffer,